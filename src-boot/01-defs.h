@@ -15,6 +15,10 @@
 // exclude the standard libraries when preprocessing the source for inspection;
 // see sh/preprocess.sh.
 #ifndef SKIP_LIB_INCLUDES
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 600 // required for ucontext.
+#define _DARWIN_C_SOURCE // restore the non-posix declarations hidden by _XOPEN_SOURCE.
+#endif
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
@@ -25,9 +29,13 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <ucontext.h>
 #include <string>
 #include <unordered_map>
 #include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #endif
 
 // enable tail-call optimizations.
@@ -35,10 +43,16 @@
 #define OPTION_TCO 1
 #endif
 
+// limit the depth of macro expansion.
 #ifndef OPTION_REC_LIMIT
 #define OPTION_REC_LIMIT (1<<10)
 #endif
 
+// limit the total size of the heap segments of the evaluation stack, in bytes.
+#ifndef OPTION_STACK_LIMIT
+#define OPTION_STACK_LIMIT (1L<<30)
+#endif
+
 // zero object words for new, moved, and released elements to catch invalid accesses.
 #ifndef OPTION_MEM_ZERO
 #define OPTION_MEM_ZERO !OPT
@@ -97,6 +111,16 @@
 // dereferencing pointer arguments is disallowed.
 #define PURE_VAL __attribute__((const))
 
+// mark a function as rarely called, so that it is kept out of line and away from hot code.
+#define COLD __attribute__((cold, noinline))
+
+// keep a function out of line, e.g. so that its locals are not merged into a caller
+// that calls a function that returns twice.
+#define NO_INLINE __attribute__((noinline))
+
+// hint that a condition is usually false.
+#define UNLIKELY(x) __builtin_expect(!!(x), 0)
+
 // suppress unused warnings. ex: UNUSED f(UNUSED Int x) {...}
 #define UNUSED __attribute__((unused))
 
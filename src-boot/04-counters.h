@@ -16,6 +16,13 @@ C(Array) \
 C(Hash_bucket) \
 C(Set) \
 C(Dict) \
+C(Btree_node) \
+C(Func_dec) \
+C(Dispatch_site) \
+C(Access_site) \
+C(Case_table) \
+C(Memo_cache) \
+C(Stack_seg) \
 C(Type_table) \
 C(Ptr_rc) \
 C(Int_rc) \
@@ -25,6 +32,12 @@ C(Data_ref_rc) \
 C(Data_ref_alloc) \
 C(Env_rc) \
 C(Env_alloc) \
+C(List_rc) \
+C(List_alloc) \
+C(Btree_rc) \
+C(Btree_alloc) \
+C(Packed_rc) \
+C(Packed_alloc) \
 C(Cmpd_rc) \
 C(Cmpd_alloc) \
 
@@ -78,16 +78,35 @@ struct Cmpd {
 } ALIGNED_TO_WORD;
 DEF_SIZE(Cmpd);
 
+struct Packed { // header for arrays of raw, unboxed elements; the element width depends on type.
+  Head head;
+  Int len;
+} ALIGNED_TO_WORD;
+DEF_SIZE(Packed);
+
+struct Btree_ref;
 struct Env;
+struct List_ref;
 struct Type;
 
 union Obj;
 
 extern const Int size_Obj;
 extern const Obj s_true, s_false, s_DISSOLVED;
-extern Obj t_Data, t_Env, t_Int, t_Ptr, t_Sym, t_Type;
+extern Obj t_Accessor, t_Btree, t_Call, t_Case, t_Data, t_Env, t_Func, t_Int, t_List,
+  t_Mutator, t_Packed_Byte, t_Packed_Int, t_Ptr, t_Sym, t_Type;
 
 static Obj env_rel_fields(Obj o);
+static Obj list_rel_fields(Obj o);
+static Int list_ref_len(Obj o);
+static void list_dissolve_els(Obj o);
+static Obj btree_rel_fields(Obj o);
+static Int btree_ref_len(Obj o);
+static void btree_dissolve_els(Obj o);
+static void func_dec_invalidate(Obj o);
+static Bool type_has_hidden(Obj type);
+static Bool type_is_cmpd(Obj type);
+static void cmpd_release_hidden(Obj o);
 static Obj type_name(Obj t);
 
 union Obj {
@@ -97,6 +116,9 @@ union Obj {
   Head* h; // common to all ref types.
   Data* d;
   Env* e;
+  List_ref* lr;
+  Btree_ref* bt;
+  Packed* p;
   Cmpd* c;
   Type* t;
   
@@ -160,7 +182,16 @@ union Obj {
 
   Bool ref_is_env() const { return ref_type() == t_Env; }
 
-  Bool ref_is_cmpd() const { return !ref_is_data() && !ref_is_env(); }
+  Bool ref_is_list() const { return ref_type() == t_List; }
+
+  Bool ref_is_btree() const { return ref_type() == t_Btree; }
+
+  Bool ref_is_packed() const {
+    Obj type = ref_type();
+    return type == t_Packed_Int || type == t_Packed_Byte;
+  }
+
+  Bool ref_is_cmpd() const { return type_is_cmpd(ref_type()); }
 
   Bool ref_is_type() const { return ref_type() == t_Type; }
 
@@ -170,6 +201,12 @@ union Obj {
 
   Bool is_env() const { return is_ref() && ref_is_env(); }
 
+  Bool is_list() const { return is_ref() && ref_is_list(); }
+
+  Bool is_btree() const { return is_ref() && ref_is_btree(); }
+
+  Bool is_packed() const { return is_ref() && ref_is_packed(); }
+
   Bool is_cmpd() const { return is_ref() && ref_is_cmpd(); }
 
   Bool is_type() const { return is_ref() && ref_is_type(); }
@@ -202,6 +239,9 @@ union Obj {
       case ot_ref: {
         if (ref_is_data()) return ci_Data_ref_rc;
         else if (ref_is_env()) return ci_Env_rc;
+        else if (ref_is_list()) return ci_List_rc;
+        else if (ref_is_btree()) return ci_Btree_rc;
+        else if (ref_is_packed()) return ci_Packed_rc;
         else return ci_Cmpd_rc;
       }
       case ot_ptr: return ci_Ptr_rc;
@@ -252,6 +292,29 @@ union Obj {
     return *this;
   }
   
+  static void ret_els(Obj* els, Int len) {
+    // increase the retain count of each object in a contiguous run by one.
+    // value-tagged objects have no count, so optimized builds only touch refs.
+#if OPTION_ALLOC_COUNT
+    for_in(i, len) {
+      els[i].ret();
+    }
+#else
+    for_in(i, len) {
+      Obj o = els[i];
+      if (o.tag() == ot_ref) {
+        assert(o.h->rc & 1 && o.h->rc < max_Uns);
+        o.h->rc += 2; // increment by two to leave the flag bit intact.
+      }
+    }
+#endif
+  }
+
+  Bool is_unique() const {
+    // true if this is a ref with a retain count of one.
+    return is_ref() && h->rc == (1<<1) + 1;
+  }
+
   void rel() const {
     // decrease the object's retain count by one, or deallocate it.
     Obj o = *this;
@@ -281,6 +344,10 @@ union Obj {
   void dissolve() const {
     if (is_cmpd()) {
       cmpd_dissolve_fields();
+    } else if (is_list()) {
+      list_dissolve_els(*this);
+    } else if (is_btree()) {
+      btree_dissolve_els(*this);
     }
     rel();
   }
@@ -291,12 +358,17 @@ union Obj {
     h->rc = 0;
     ref_type().rel();
     Obj tail;
-    if (ref_is_data()) { // no extra action required.
-      tail = obj0;
+    if (ref_is_cmpd()) {
+      if (type_has_hidden(ref_type())) cmpd_release_hidden(*this);
+      tail = cmpd_rel_fields();
     } else if (ref_is_env()) {
       tail = env_rel_fields(*this);
-    } else {
-      tail = cmpd_rel_fields();
+    } else if (ref_is_list()) {
+      tail = list_rel_fields(*this);
+    } else if (ref_is_btree()) {
+      tail = btree_rel_fields(*this);
+    } else { // Data and Packed; no extra action required.
+      tail = obj0;
     }
     // ret/rel counter has already been decremented by rc_rel.
 #if !OPTION_DEALLOC_PRESERVE
@@ -392,6 +464,9 @@ union Obj {
         Obj type = ref_type();
         if (type == t_Data) return *this != blank;
         if (type == t_Env) return true;
+        if (type == t_List) return !!list_ref_len(*this);
+        if (type == t_Btree) return !!btree_ref_len(*this);
+        if (type == t_Packed_Int || type == t_Packed_Byte) return !!p->len;
         return !!cmpd_len();
       }
       case ot_ptr:
@@ -563,11 +638,9 @@ public:
       return ret();
     }
     Obj slice = Obj::Cmpd_raw(ref_type().ret(), ls);
-    Obj* src = cmpd_els();
     Obj* dst = slice.cmpd_els();
-    for_in(idx, ls) {
-      dst[idx] = src[idx + fr].ret();
-    }
+    memcpy(dst, cmpd_els() + fr, Uns(ls * size_Obj));
+    ret_els(dst, ls);
     return slice;
   }
 
@@ -596,12 +669,19 @@ public:
   static Obj Cmpd_raw(Obj type, Int len) {
     // owns type.
     counter_inc(ci_Cmpd_rc);
-    Obj o = Obj(raw_alloc(size_Cmpd + (size_Obj * len), ci_Cmpd_alloc));
+    Int size = size_Cmpd + (size_Obj * len);
+    // instances of some core types have a hidden word after the elements; see type_has_hidden.
+    Bool has_hidden = type_has_hidden(type);
+    Obj o = Obj(raw_alloc(size + (has_hidden ? size_Int : 0), ci_Cmpd_alloc));
     *o.h = Head(type.r);
     o.c->len = len;
   #if OPTION_MEM_ZERO
     memset(o.cmpd_els_unchecked(), 0, Uns(size_Obj * len));
   #endif
+    if (has_hidden) {
+      // ti_none, or no cache.
+      *reinterpret_cast<Int*>(o.cmpd_els_unchecked() + len) = 0;
+    }
     return o;
   }
   
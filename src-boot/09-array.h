@@ -95,15 +95,19 @@ public:
     }
   }
 
-  void dealloc(Bool dbg_cleared=true) {
+  void assert_cleared() {
     // elements must have been previously moved or cleared.
-    if (OPTION_MEM_ZERO && dbg_cleared) {
+    if (OPTION_MEM_ZERO) {
 #if !OPT
       for_val(el, *this) {
         assert(!el.vld());
       }
 #endif
     }
+  }
+
+  void dealloc(Bool dbg_cleared=true) {
+    if (dbg_cleared) assert_cleared();
     raw_dealloc(_els, ci_Array);
   }
 
@@ -28,6 +28,8 @@ public:
 
   Obj* end() const { return _array.begin() + _len; }
 
+  Int cap() { return _array.len(); }
+
   void grow_cap() {
     assert(vld());
     // minimum capacity is 2 given 8 byte words with 16 byte min malloc.
@@ -35,6 +37,14 @@ public:
     _array.grow(cap);
   }
 
+  void reserve(Int cap) {
+    // ensure that at least cap elements fit without further reallocation.
+    assert(vld());
+    if (cap > _array.len()) {
+      _array.grow(cap);
+    }
+  }
+
   Obj el(Int i) {
     // return element i in array with no ownership changes.
     assert(vld() && i < _len);
@@ -63,6 +73,37 @@ public:
     return i;
   }
 
+  void extend(Obj* els, Int len) {
+    // append len borrowed elements, retaining them.
+    // to extend a list from itself, reserve first so that els remains valid.
+    assert(vld() && len >= 0);
+    reserve(_len + len);
+    Obj* dst = _array.els() + _len;
+    memcpy(dst, els, Uns(len * size_Obj));
+    Obj::ret_els(dst, len);
+    _len += len;
+  }
+
+  void insert(Int i, Obj o) {
+    // insert o at index i, shifting subsequent elements up by one; owns o.
+    assert(vld() && i >= 0 && i <= _len);
+    if (_len == _array.len()) {
+      grow_cap();
+    }
+    Obj* els = _array.els();
+    memmove(els + i + 1, els + i, Uns((_len - i) * size_Obj));
+    _len++;
+    els[i] = o; // slot still holds a stale copy of the shifted element, so put would fail.
+  }
+
+  Obj pop() {
+    // move the last element out of the list.
+    assert(vld() && _len > 0);
+    Obj o = el_move(_len - 1);
+    _len--;
+    return o;
+  }
+
   Obj drop(Int i) {
     // remove element i; if there is a last element, move it into this position.
     assert(vld() && i >= 0 && i < _len);
@@ -118,3 +159,49 @@ public:
   }
 
 };
+
+
+// List objects: a ref type that wraps a List, so that ploy code can append without copying.
+
+struct List_ref {
+  Head head;
+  List list;
+} ALIGNED_TO_WORD;
+DEF_SIZE(List_ref);
+
+
+static Obj List_new(Int cap) {
+  counter_inc(ci_List_rc);
+  Obj o = Obj(raw_alloc(size_List_ref, ci_List_alloc));
+  *o.h = Head(t_List.ret().r);
+  o.lr->list = cap ? List(cap) : List();
+  return o;
+}
+
+
+static Int list_ref_len(Obj o) {
+  assert(o.ref_is_list());
+  return o.lr->list.len();
+}
+
+
+static Obj list_rel_fields(Obj o) {
+  // returns last element for release by parent; this is a c tail call optimization.
+  List& l = o.lr->list;
+  Obj tail = l.len() ? l.pop() : obj0;
+  l.rel_els_dealloc();
+#if OPTION_TCO
+  return tail;
+#else
+  if (tail.vld()) tail.rel();
+  return obj0;
+#endif
+}
+
+
+static void list_dissolve_els(Obj o) {
+  for_mut(el, o.lr->list) {
+    el.rel();
+    el = s_DISSOLVED.ret_val();
+  }
+}
@@ -18,6 +18,7 @@ S(ENV_END) \
 S(ENV_FRAME_KEY) \
 S(ENV_FRAME_VAL) \
 S(UNINIT) \
+S(SPLICED_ARR) \
 S(false) \
 S(true) \
 S(INFER_STRUCT) \
@@ -32,6 +33,7 @@ S(self) \
 S(a) \
 S(b) \
 S(c) \
+S(d) \
 S(callee) \
 S(types) \
 S(Arr) \
@@ -39,6 +41,16 @@ S(Arr_Expr) \
 S(Labeled_args) \
 S(Obj) \
 S(Expr) \
+S(eq) \
+S(ne) \
+S(lt) \
+S(le) \
+S(gt) \
+S(ge) \
+S(lru) \
+S(clock) \
+S(id) \
+S(val) \
 
 
 // sym indices.
@@ -11,10 +11,13 @@ struct Type {
   Int len;
   Obj name;
   Obj kind;
+  Int index; // not an element; allocated and zeroed by Cmpd_raw.
 } ALIGNED_TO_WORD;
 DEF_SIZE(Type);
 
 
+// the ref types whose instances are not Cmpds must stay contiguous, from Data to Packed_Byte;
+// see type_is_cmpd.
 #define TYPE_LIST \
 T(Type,             struct2, "name", t_Expr, "kind", t_Type_kind) \
 T(Ptr,              prim) \
@@ -22,6 +25,10 @@ T(Int,              prim) \
 T(Sym,              prim) \
 T(Data,             prim) \
 T(Env,              prim) \
+T(List,             prim) \
+T(Btree,            prim) \
+T(Packed_Int,       prim) \
+T(Packed_Byte,      prim) \
 T(Comment,          struct2, "is-expr", t_Bool, "val", t_Expr) \
 T(Qua,              struct1, "expr", t_Expr) \
 T(Unq,              struct1, "expr", t_Expr) \
@@ -33,9 +40,18 @@ T(Mutator,          struct1, "name", t_Sym) \
 T(Pub,              struct1, "expr", t_Expr) \
 T(Expand,           struct1, "exprs", t_Arr_Expr) \
 T(Call,             struct1, "exprs", t_Arr_Expr) \
+T(Int_op,           struct2, "op", t_Int, "call", t_Call) \
+T(Cons_struct,      struct2, "type", t_Type, "call", t_Call) \
+T(Inlined,          struct4, "call", t_Call, "func", t_Func, "fields", t_Arr_Obj, "body", t_Expr) \
 T(Syn_seq,          struct1, "exprs", t_Arr_Expr) \
 T(If,               struct1, "exprs", t_Arr_Expr) \
 T(Let,              struct1, "exprs", t_Arr_Expr) \
+T(Loop,             struct1, "exprs", t_Arr_Expr) \
+T(Each,             struct1, "exprs", t_Arr_Expr) \
+T(Case,             struct1, "exprs", t_Arr_Expr) \
+T(Values,           struct1, "exprs", t_Arr_Expr) \
+T(Let_vals,         struct1, "exprs", t_Arr_Expr) \
+T(Memo,             struct4, "capacity", t_Int, "evict", t_Sym, "key", t_Sym, "body", t_Expr) \
 T(Label,            struct3, "name", t_Expr, "type", t_Expr, "expr", t_Expr) \
 T(Variad,           struct2, "name", t_Expr, "type", t_Expr) \
 T(Fn,               struct_fn) \
@@ -71,6 +87,15 @@ TYPE_LIST
 TYPE_LIST
 #undef T
 
+// each core type stores its index, so that the evaluator can switch on the type of a form.
+// types created at runtime have ti_none.
+#define T(t, ...) ti_##t,
+enum Type_index {
+  ti_none,
+  TYPE_LIST
+};
+#undef T
+
 
 static Obj type_name(Obj t) {
   assert(t.is_type());
@@ -80,6 +105,48 @@ static Obj type_name(Obj t) {
 }
 
 
+static Type_index type_index(Obj t) {
+  assert(t.is_type());
+  assert(t.cmpd_len() == 2);
+  return Type_index(t.t->index);
+}
+
+
+static Bool type_is_cmpd(Obj type) {
+  // true if instances of type are Cmpds: every type but Data, Env, List, Btree and Packed,
+  // which occupy a single range of indices.
+  // during type_init_vars, t_Type is obj0 when Type itself is allocated.
+  if (!type.vld()) return true;
+  return Uns(type.t->index - ti_Data) > Uns(ti_Packed_Byte - ti_Data);
+}
+
+
+static Bool type_has_hidden(Obj type) {
+  // true if instances of type have a hidden word after their elements, zeroed by Cmpd_raw:
+  // the index of a Type; the captured syms of a Fn (see compile_fn_syms_slot in 27-compile.h);
+  // the mutation count at which an Inlined node last found its Func unchanged (see run_Inlined);
+  // and the Func_dec, Dispatch_site, Access_site, Case_table and Memo_cache of the other forms
+  // (see 28-run.h), which cmpd_release_hidden frees when the instance is deallocated.
+  // during type_init_vars, t_Type is obj0 when Type itself is allocated,
+  // and is not yet a complete Type when the others are, so the index is read directly.
+  if (!type.vld()) return true;
+  switch (type.t->index) {
+    case ti_Type:
+    case ti_Fn:
+    case ti_Func:
+    case ti_Call:
+    case ti_Accessor:
+    case ti_Mutator:
+    case ti_Case:
+    case ti_Memo:
+    case ti_Inlined:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
 static Obj type_kind(Obj t) {
   assert(t.is_type());
   Obj kind = t.cmpd_el(1);
@@ -92,7 +159,7 @@ static Bool is_kind_arr(Obj kind)     { return kind.type() == t_Type_kind_arr; }
 static Bool is_kind_unit(Obj kind)    { return kind.type() == t_Type_kind_unit; }
 
 
-UNUSED static Obj kind_el_type(Obj kind) {
+static Obj kind_el_type(Obj kind) {
   assert(is_kind_arr(kind));
   return kind.cmpd_el(0);
 }
@@ -202,7 +269,7 @@ static Obj type_kind_struct_src_loc() {
 
 
 static Obj type_kind_union_expr() {
-  return Obj::Cmpd(t_Type_kind_struct.ret(),
+  return Obj::Cmpd(t_Type_kind_union.ret(),
       Obj::Cmpd(t_Arr_Type.ret(),
       t_Int.ret(),
       t_Sym.ret(),
@@ -218,9 +285,18 @@ static Obj type_kind_union_expr() {
       t_Pub.ret(),
       t_Expand.ret(),
       t_Call.ret(),
+      t_Int_op.ret(),
+      t_Cons_struct.ret(),
+      t_Inlined.ret(),
       t_Syn_seq.ret(),
       t_If.ret(),
       t_Let.ret(),
+      t_Loop.ret(),
+      t_Each.ret(),
+      t_Case.ret(),
+      t_Values.ret(),
+      t_Let_vals.ret(),
+      t_Memo.ret(),
       t_Label.ret(),
       t_Variad.ret(),
       t_Fn.ret(),
@@ -229,7 +305,7 @@ static Obj type_kind_union_expr() {
 
 
 static Obj type_kind_union_type_kind() {
-  return Obj::Cmpd(t_Type_kind_struct.ret(),
+  return Obj::Cmpd(t_Type_kind_union.ret(),
     Obj::Cmpd(t_Arr_Type.ret(),
       t_Type_kind_unit.ret(),
       t_Type_kind_prim.ret(),
@@ -293,6 +369,67 @@ static Obj labeled_args_type(Obj el_type) {
 }
 
 
+// type conformance.
+// a value conforms to a required type if its type is the required type,
+// or conforms to one of the variants of a required union,
+// or if the required type is Obj or a type var.
+// array types conform if their element types conform.
+// Bool is a class of two Sym values, so it is decided by value.
+// conformance of (actual, required) type pairs is memoized in a small direct-mapped cache;
+// the entries retain both types, so that a cached address is never reused by another type.
+
+struct Type_conform_entry {
+  Obj act;
+  Obj req;
+  Bool res;
+};
+
+static const Int len_type_conform_cache = 1<<8;
+static Type_conform_entry type_conform_cache[len_type_conform_cache];
+
+
+static Bool type_conforms_uncached(Obj act, Obj req) {
+  if (act == req || req == t_Obj) return true;
+  if (!req.is_type()) return false;
+  Obj kind = type_kind(req);
+  Obj kind_type = kind.type();
+  if (kind_type == t_Type_kind_var) return true;
+  if (kind_type == t_Type_kind_arr) { // arrays conform covariantly, e.g. Arr-Int to Arr-Obj.
+    if (!act.is_type() || !is_kind_arr(type_kind(act))) return false;
+    return type_conforms_uncached(kind_el_type(type_kind(act)), kind_el_type(kind));
+  }
+  if (kind_type != t_Type_kind_union) return false;
+  for_val(variant, kind.cmpd_el(0).cmpd_it()) {
+    if (type_conforms_uncached(act, variant)) return true;
+  }
+  return false;
+}
+
+
+static Bool type_conforms(Obj act, Obj req) {
+  // borrows act, req.
+  if (act == req || req == t_Obj) return true;
+  Uns h = Uns(act.id_hash() ^ (req.id_hash() * 31)) % len_type_conform_cache;
+  Type_conform_entry& e = type_conform_cache[h];
+  if (e.act == act && e.req == req) return e.res;
+  if (e.act.vld()) {
+    e.act.rel();
+    e.req.rel();
+  }
+  e.act = act.ret();
+  e.req = req.ret();
+  e.res = type_conforms_uncached(act, req);
+  return e.res;
+}
+
+
+static Bool val_conforms(Obj val, Obj req) {
+  // borrows val, req.
+  if (req == t_Bool) return val.is_bool();
+  return type_conforms(val.type(), req);
+}
+
+
 static void fix_arr_type(Obj el_type, Obj type) {
   Obj name = derive_arr_type_sym(s_Arr, el_type);
   type.cmpd_el_move(0).rel_val();
@@ -306,7 +443,7 @@ static void type_init_vars() {
   // so that the t_* values are not obj0.
   // thus we must initialize the types in two phases.
   // note that Cmpd_raw does not retain the type argument.
-#define T(t, ...) t_##t = Obj::Cmpd_raw(t_Type, 2);
+#define T(n, ...) t_##n = Obj::Cmpd_raw(t_Type, 2); t_##n.t->index = ti_##n;
   TYPE_LIST
 #undef T
   // t_Type does not yet point to itself.
@@ -367,6 +504,13 @@ static Obj type_init_values(Obj env) {
 
 #if OPTION_ALLOC_COUNT
 static void type_cleanup() {
+  for_in(i, len_type_conform_cache) {
+    Type_conform_entry& e = type_conform_cache[i];
+    if (!e.act.vld()) continue;
+    e.act.rel();
+    e.req.rel();
+    e = {obj0, obj0, false};
+  }
   unit_inst_memo.rel_els_dealloc();
   arr_types_memo.rel_els_dealloc();
   labeled_args_types_memo.rel_els_dealloc();
@@ -60,6 +60,22 @@ static void write_repr_Env(CFile f, Obj env) {
 
 static void write_repr_obj(CFile f, Obj o, Bool is_quoted, Int depth, Set& set);
 
+// defined in 20-btree.h.
+static void write_repr_Btree(CFile f, Obj o, Bool is_quoted, Int depth, Set& set);
+// defined in 21-packed.h.
+static void write_repr_Packed(CFile f, Obj o, Bool is_quoted);
+
+static void write_repr_List(CFile f, Obj l, Bool is_quoted, Int depth, Set& set) {
+  if (is_quoted) fputs("¿", f);
+  fputs(NO_REPR_PO "List", f);
+  for_val(el, l.lr->list) {
+    fputc(' ', f);
+    write_repr_obj(f, el, false, depth, set);
+  }
+  fputs(NO_REPR_PC, f);
+}
+
+
 static void write_repr_Comment(CFile f, Obj o, UNUSED Bool is_quoted, Int depth, Set& set) {
   assert(o.cmpd_len() == 2);
   fputs(NO_REPR_PO "#", f);
@@ -247,6 +263,18 @@ static void write_repr_dispatch(CFile f, Obj s, Bool is_quoted, Int depth, Set&
   Obj type = s.type();
   if (type == t_Data) { write_repr_Data(f, s); return; }
   if (type == t_Env)  { write_repr_Env(f, s); return; }
+  if (type == t_List) { write_repr_List(f, s, is_quoted, depth, set); return; }
+  if (type == t_Btree) { write_repr_Btree(f, s, is_quoted, depth, set); return; }
+  if (type == t_Packed_Int || type == t_Packed_Byte) { write_repr_Packed(f, s, is_quoted); return; }
+  if ((type == t_Int_op || type == t_Cons_struct) && s.cmpd_len() == 2) {
+    // show the call that the node replaced.
+    write_repr_obj(f, s.cmpd_el(1), is_quoted, depth, set);
+    return;
+  }
+  if (type == t_Inlined && s.cmpd_len() == 4) { // show the call that was inlined.
+    write_repr_obj(f, s.cmpd_el(0), is_quoted, depth, set);
+    return;
+  }
 
   #define DISP(t) \
   if (type == t_##t) { write_repr_##t(f, s, is_quoted, depth, set); return; }
@@ -0,0 +1,502 @@
+// Copyright 2014 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+// ordered map implemented as a B-tree.
+// keys are Int or Data; Ints order numerically and before all Data,
+// and Data orders byte-wise, with a shorter prefix ordering first.
+// each node stores its keys contiguously, so that a search touches few cache lines.
+
+#include "19-parse.h"
+
+
+static Int btree_key_cmp(Obj a, Obj b) {
+  // returns -1, 0, or 1.
+  if (a.is_int()) {
+    if (!b.is_int()) return -1;
+    // tagged Int words preserve the ordering of their values.
+    return (a.i > b.i) - (a.i < b.i);
+  }
+  if (b.is_int()) return 1;
+  assert(a.is_data() && b.is_data());
+  Str sa = a.data_str();
+  Str sb = b.data_str();
+  Int len = int_min(sa.len, sb.len);
+  I32 r = len ? memcmp(sa.chars, sb.chars, Uns(len)) : 0;
+  if (r) return sign(r);
+  return sign(sa.len - sb.len);
+}
+
+
+// minimum degree: every node except the root holds between t-1 and 2t-1 keys.
+static const Int btree_min_deg = 16;
+static const Int btree_max_keys = btree_min_deg * 2 - 1;
+
+struct Btree_node {
+  Int len;
+  Bool is_leaf;
+  Obj keys[btree_max_keys];
+  Obj vals[btree_max_keys];
+  Btree_node* children[btree_max_keys + 1]; // not allocated for leaves.
+};
+DEF_SIZE(Btree_node);
+
+static const Int size_Btree_leaf = size_Btree_node - (btree_max_keys + 1) * size_Raw;
+
+
+static Btree_node* btree_node_new(Bool is_leaf) {
+  Btree_node* n = static_cast<Btree_node*>(
+    raw_alloc(is_leaf ? size_Btree_leaf : size_Btree_node, ci_Btree_node));
+  n->len = 0;
+  n->is_leaf = is_leaf;
+  return n;
+}
+
+
+static void btree_node_dealloc(Btree_node* n) {
+  raw_dealloc(n, ci_Btree_node);
+}
+
+
+static Int btree_node_lower_bound(Btree_node* n, Obj k) {
+  // return the index of the first key that is not less than k.
+  Int lo = 0;
+  Int hi = n->len;
+  while (lo < hi) {
+    Int mid = (lo + hi) / 2;
+    if (btree_key_cmp(n->keys[mid], k) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+static void btree_node_shift_up(Btree_node* n, Int i) {
+  // open a key slot at i; child slots are not moved.
+  Uns size = Uns((n->len - i) * size_Obj);
+  memmove(n->keys + i + 1, n->keys + i, size);
+  memmove(n->vals + i + 1, n->vals + i, size);
+}
+
+
+static void btree_node_shift_down(Btree_node* n, Int i) {
+  // close the key slot at i; child slots are not moved.
+  Uns size = Uns((n->len - i - 1) * size_Obj);
+  memmove(n->keys + i, n->keys + i + 1, size);
+  memmove(n->vals + i, n->vals + i + 1, size);
+}
+
+
+class Btree {
+  Int _len;
+  Btree_node* _root;
+
+  static void split_child(Btree_node* x, Int i) {
+    // split the full child i of x, moving its median key up into x.
+    Btree_node* y = x->children[i];
+    assert(y->len == btree_max_keys);
+    const Int t = btree_min_deg;
+    Btree_node* z = btree_node_new(y->is_leaf);
+    z->len = t - 1;
+    memcpy(z->keys, y->keys + t, Uns((t - 1) * size_Obj));
+    memcpy(z->vals, y->vals + t, Uns((t - 1) * size_Obj));
+    if (!y->is_leaf) {
+      memcpy(z->children, y->children + t, Uns(t * size_Raw));
+    }
+    y->len = t - 1;
+    btree_node_shift_up(x, i);
+    memmove(x->children + i + 2, x->children + i + 1, Uns((x->len - i) * size_Raw));
+    x->keys[i] = y->keys[t - 1];
+    x->vals[i] = y->vals[t - 1];
+    x->children[i + 1] = z;
+    x->len++;
+  }
+
+  static void merge_children(Btree_node* x, Int i) {
+    // merge child i + 1 of x and the separating key into child i.
+    Btree_node* y = x->children[i];
+    Btree_node* z = x->children[i + 1];
+    assert(y->len + z->len < btree_max_keys);
+    y->keys[y->len] = x->keys[i];
+    y->vals[y->len] = x->vals[i];
+    memcpy(y->keys + y->len + 1, z->keys, Uns(z->len * size_Obj));
+    memcpy(y->vals + y->len + 1, z->vals, Uns(z->len * size_Obj));
+    if (!y->is_leaf) {
+      memcpy(y->children + y->len + 1, z->children, Uns((z->len + 1) * size_Raw));
+    }
+    y->len += z->len + 1;
+    btree_node_shift_down(x, i);
+    memmove(x->children + i + 1, x->children + i + 2, Uns((x->len - i - 1) * size_Raw));
+    x->len--;
+    btree_node_dealloc(z);
+  }
+
+  static Int fill_child(Btree_node* x, Int i) {
+    // ensure that child i of x has at least t keys before descending into it.
+    // returns the index of the child that now contains the keys of the original child.
+    const Int t = btree_min_deg;
+    Btree_node* c = x->children[i];
+    if (c->len >= t) return i;
+    if (i > 0 && x->children[i - 1]->len >= t) { // rotate right through x.
+      Btree_node* l = x->children[i - 1];
+      btree_node_shift_up(c, 0);
+      if (!c->is_leaf) {
+        memmove(c->children + 1, c->children, Uns((c->len + 1) * size_Raw));
+        c->children[0] = l->children[l->len];
+      }
+      c->keys[0] = x->keys[i - 1];
+      c->vals[0] = x->vals[i - 1];
+      c->len++;
+      x->keys[i - 1] = l->keys[l->len - 1];
+      x->vals[i - 1] = l->vals[l->len - 1];
+      l->len--;
+      return i;
+    }
+    if (i < x->len && x->children[i + 1]->len >= t) { // rotate left through x.
+      Btree_node* r = x->children[i + 1];
+      c->keys[c->len] = x->keys[i];
+      c->vals[c->len] = x->vals[i];
+      if (!c->is_leaf) {
+        c->children[c->len + 1] = r->children[0];
+        memmove(r->children, r->children + 1, Uns(r->len * size_Raw));
+      }
+      c->len++;
+      x->keys[i] = r->keys[0];
+      x->vals[i] = r->vals[0];
+      btree_node_shift_down(r, 0);
+      r->len--;
+      return i;
+    }
+    if (i < x->len) {
+      merge_children(x, i);
+      return i;
+    }
+    merge_children(x, i - 1);
+    return i - 1;
+  }
+
+  Obj remove_in(Btree_node* x, Obj k, Obj* removed_key) {
+    // remove k from the subtree rooted at x, which has at least t keys unless it is the root.
+    // returns the removed val and sets removed_key, both owned by the caller, or obj0.
+    loop {
+      Int i = btree_node_lower_bound(x, k);
+      Bool found = (i < x->len && btree_key_cmp(x->keys[i], k) == 0);
+      if (found && x->is_leaf) {
+        *removed_key = x->keys[i];
+        Obj val = x->vals[i];
+        btree_node_shift_down(x, i);
+        x->len--;
+        _len--;
+        return val;
+      }
+      if (found) { // internal node; replace the key with its predecessor or successor.
+        Btree_node* y = x->children[i];
+        Btree_node* z = x->children[i + 1];
+        if (y->len >= btree_min_deg || z->len >= btree_min_deg) {
+          Obj adj_key;
+          Obj adj_val;
+          if (y->len >= btree_min_deg) {
+            Btree_node* n = y;
+            while (!n->is_leaf) n = n->children[n->len];
+            adj_val = remove_in(y, n->keys[n->len - 1], &adj_key);
+          } else {
+            Btree_node* n = z;
+            while (!n->is_leaf) n = n->children[0];
+            adj_val = remove_in(z, n->keys[0], &adj_key);
+          }
+          _len++; // the recursive removal counted the moved item.
+          *removed_key = x->keys[i];
+          Obj val = x->vals[i];
+          x->keys[i] = adj_key;
+          x->vals[i] = adj_val;
+          _len--;
+          return val;
+        }
+        merge_children(x, i); // k is now the median key of child i.
+        x = y;
+        continue;
+      }
+      if (x->is_leaf) {
+        return obj0; // not found.
+      }
+      i = fill_child(x, i);
+      x = x->children[i];
+    }
+  }
+
+  static Btree_node* build(Obj* keys, Obj* vals, Int n, Int height, Int span, Bool is_root) {
+    // build a subtree of the given height from n sorted items; owns the items.
+    // span is the maximum number of items in a child subtree, plus one.
+    if (!height) {
+      assert(n <= btree_max_keys);
+      Btree_node* leaf = btree_node_new(true);
+      memcpy(leaf->keys, keys, Uns(n * size_Obj));
+      memcpy(leaf->vals, vals, Uns(n * size_Obj));
+      leaf->len = n;
+      return leaf;
+    }
+    // use the fewest children that can hold the items, but no fewer than t for a non-root node;
+    // the items are spread evenly so that every child is at least half full.
+    Int len_children = (n + span) / span; // ceil((n + 1) / span).
+    if (!is_root) len_children = int_max(len_children, btree_min_deg);
+    assert(len_children >= 2 && len_children <= btree_max_keys + 1);
+    Int len_child_items = n - (len_children - 1);
+    Int q = len_child_items / len_children;
+    Int r = len_child_items % len_children;
+    Btree_node* node = btree_node_new(false);
+    Int off = 0;
+    for_in(i, len_children) {
+      Int l = q + (i < r ? 1 : 0);
+      node->children[i] = build(keys + off, vals + off, l, height - 1, span / (btree_max_keys + 1),
+        false);
+      off += l;
+      if (i < len_children - 1) {
+        node->keys[i] = keys[off];
+        node->vals[i] = vals[off];
+        off++;
+      }
+    }
+    assert(off == n);
+    node->len = len_children - 1;
+    return node;
+  }
+
+  static void rel_node(Btree_node* n) {
+    for_in(i, n->len) {
+      n->keys[i].rel();
+      n->vals[i].rel();
+    }
+    if (!n->is_leaf) {
+      for_in(i, n->len + 1) {
+        rel_node(n->children[i]);
+      }
+    }
+    btree_node_dealloc(n);
+  }
+
+  static void dissolve_node(Btree_node* n) {
+    for_in(i, n->len) {
+      n->vals[i].dissolve();
+      n->vals[i] = s_DISSOLVED.ret_val();
+    }
+    if (!n->is_leaf) {
+      for_in(i, n->len + 1) {
+        dissolve_node(n->children[i]);
+      }
+    }
+  }
+
+  static void range_node(Btree_node* n, Obj lo, Obj hi, List& out, Bool* done) {
+    Int i = lo.vld() ? btree_node_lower_bound(n, lo) : 0;
+    for (; i <= n->len; i++) {
+      if (!n->is_leaf) {
+        range_node(n->children[i], lo, hi, out, done);
+        if (*done) return;
+      }
+      if (i == n->len) return;
+      if (hi.vld() && btree_key_cmp(n->keys[i], hi) >= 0) {
+        *done = true;
+        return;
+      }
+      out.append(n->keys[i].ret());
+      out.append(n->vals[i].ret());
+    }
+  }
+
+public:
+
+  Btree(): _len(0), _root(null) {}
+
+  Bool vld() { return _root ? _len > 0 : !_len; }
+
+  Int len() { return _len; }
+
+  Obj fetch(Obj k) {
+    // returns the borrowed val for k, or obj0.
+    assert(vld());
+    Btree_node* n = _root;
+    while (n) {
+      Int i = btree_node_lower_bound(n, k);
+      if (i < n->len && btree_key_cmp(n->keys[i], k) == 0) {
+        return n->vals[i];
+      }
+      n = n->is_leaf ? null : n->children[i];
+    }
+    return obj0;
+  }
+
+  Obj insert(Obj k, Obj v) {
+    // owns k, v.
+    // returns the replaced val, owned by the caller, or obj0 if k is new.
+    assert(vld());
+    if (!_root) {
+      _root = btree_node_new(true);
+    } else if (_root->len == btree_max_keys) {
+      Btree_node* r = btree_node_new(false);
+      r->children[0] = _root;
+      split_child(r, 0);
+      _root = r;
+    }
+    Btree_node* x = _root;
+    loop {
+      Int i = btree_node_lower_bound(x, k);
+      if (i < x->len && btree_key_cmp(x->keys[i], k) == 0) {
+        Obj old = x->vals[i];
+        x->vals[i] = v;
+        k.rel();
+        return old;
+      }
+      if (x->is_leaf) {
+        btree_node_shift_up(x, i);
+        x->keys[i] = k;
+        x->vals[i] = v;
+        x->len++;
+        _len++;
+        return obj0;
+      }
+      if (x->children[i]->len == btree_max_keys) {
+        split_child(x, i);
+        Int c = btree_key_cmp(k, x->keys[i]);
+        if (!c) continue; // the promoted median is k; replace its val on the next pass.
+        if (c > 0) i++;
+      }
+      x = x->children[i];
+    }
+  }
+
+  Obj remove(Obj k) {
+    // returns the removed val, owned by the caller, or obj0 if k is not present.
+    assert(vld());
+    if (!_root) return obj0;
+    Obj removed_key;
+    Obj val = remove_in(_root, k, &removed_key);
+    if (val.vld()) {
+      removed_key.rel();
+    }
+    if (!_root->len) { // shrink the tree.
+      Btree_node* r = _root;
+      _root = r->is_leaf ? null : r->children[0];
+      btree_node_dealloc(r);
+    }
+    return val;
+  }
+
+  Obj floor(Obj k) {
+    // returns the borrowed greatest key not greater than k, or obj0.
+    Obj best = obj0;
+    Btree_node* n = _root;
+    while (n) {
+      Int i = btree_node_lower_bound(n, k);
+      if (i < n->len && btree_key_cmp(n->keys[i], k) == 0) return n->keys[i];
+      if (i > 0) best = n->keys[i - 1];
+      n = n->is_leaf ? null : n->children[i];
+    }
+    return best;
+  }
+
+  Obj ceil(Obj k) {
+    // returns the borrowed least key not less than k, or obj0.
+    Obj best = obj0;
+    Btree_node* n = _root;
+    while (n) {
+      Int i = btree_node_lower_bound(n, k);
+      if (i < n->len) {
+        best = n->keys[i];
+        if (btree_key_cmp(best, k) == 0) return best;
+      }
+      n = n->is_leaf ? null : n->children[i];
+    }
+    return best;
+  }
+
+  void range(Obj lo, Obj hi, List& out) {
+    // append retained key, val pairs with lo <= key < hi to out, in order;
+    // an invalid bound is open.
+    if (!_root) return;
+    Bool done = false;
+    range_node(_root, lo, hi, out, &done);
+  }
+
+  void load_sorted(Obj* keys, Obj* vals, Int n) {
+    // build the tree in linear time from n strictly increasing keys; owns the items.
+    assert(!_root);
+    if (!n) return;
+    Int height = 0;
+    Int span = 1; // maximum items in a subtree of height - 1, plus one.
+    Int cap = btree_max_keys;
+    while (cap < n) {
+      check(cap <= max_Int / (btree_max_keys + 1), "Btree: load exceeded max height");
+      height++;
+      span *= btree_max_keys + 1;
+      cap = cap * (btree_max_keys + 1) + btree_max_keys;
+    }
+    _root = build(keys, vals, n, height, span, true);
+    _len = n;
+  }
+
+  void rel_els_dealloc() {
+    if (_root) {
+      rel_node(_root);
+    }
+    _root = null;
+    _len = 0;
+  }
+
+  void dissolve_vals() {
+    if (_root) {
+      dissolve_node(_root);
+    }
+  }
+
+};
+
+
+// Btree objects: a ref type that wraps a Btree.
+
+struct Btree_ref {
+  Head head;
+  Btree tree;
+} ALIGNED_TO_WORD;
+DEF_SIZE(Btree_ref);
+
+
+static Obj Btree_new() {
+  counter_inc(ci_Btree_rc);
+  Obj o = Obj(raw_alloc(size_Btree_ref, ci_Btree_alloc));
+  *o.h = Head(t_Btree.ret().r);
+  o.bt->tree = Btree();
+  return o;
+}
+
+
+static Int btree_ref_len(Obj o) {
+  assert(o.ref_is_btree());
+  return o.bt->tree.len();
+}
+
+
+static Obj btree_rel_fields(Obj o) {
+  o.bt->tree.rel_els_dealloc();
+  return obj0;
+}
+
+
+static void btree_dissolve_els(Obj o) {
+  o.bt->tree.dissolve_vals();
+}
+
+
+static void write_repr_Btree(CFile f, Obj o, Bool is_quoted, Int depth, Set& set) {
+  if (is_quoted) fputs("¿", f);
+  fputs(NO_REPR_PO "Btree", f);
+  List items;
+  o.bt->tree.range(obj0, obj0, items);
+  for_val(el, items) {
+    fputc(' ', f);
+    write_repr_obj(f, el, false, depth, set);
+  }
+  items.rel_els_dealloc();
+  fputs(NO_REPR_PC, f);
+}
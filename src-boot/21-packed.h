@@ -0,0 +1,97 @@
+// Copyright 2014 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+// packed arrays: fixed-length arrays of raw, unboxed elements.
+// unlike Arr-Int, elements are not tagged objects, so access requires no tag checks,
+// and release requires no walk over the elements.
+// Packed-Int stores Int elements; Packed-Byte stores U8 elements.
+
+#include "20-btree.h"
+
+
+static Int packed_el_width(Obj type) {
+  if (type == t_Packed_Int) return size_Int;
+  assert(type == t_Packed_Byte);
+  return 1;
+}
+
+
+static Obj Packed_new(Obj type, Int len) {
+  // owns type; the elements are zeroed.
+  assert(len >= 0);
+  Int width = packed_el_width(type);
+  check(len <= (max_Int - size_Packed) / width, "Packed: len exceeds max: %i", len);
+  Int size = len * width;
+  counter_inc(ci_Packed_rc);
+  Obj o = Obj(raw_alloc(size_Packed + size, ci_Packed_alloc));
+  *o.h = Head(type.r);
+  o.p->len = len;
+  memset(o.p + 1, 0, Uns(size));
+  return o;
+}
+
+
+static Int packed_len(Obj o) {
+  assert(o.ref_is_packed());
+  return o.p->len;
+}
+
+
+static Int* packed_ints(Obj o) {
+  assert(o.ref_type() == t_Packed_Int);
+  return reinterpret_cast<Int*>(o.p + 1); // address past packed header.
+}
+
+
+static U8* packed_bytes(Obj o) {
+  assert(o.ref_type() == t_Packed_Byte);
+  return reinterpret_cast<U8*>(o.p + 1); // address past packed header.
+}
+
+
+static Int packed_el(Obj o, Int i) {
+  assert(i >= 0 && i < packed_len(o));
+  if (o.ref_type() == t_Packed_Int) return packed_ints(o)[i];
+  return packed_bytes(o)[i];
+}
+
+
+static void packed_put(Obj o, Int i, Int v) {
+  // the caller must ensure that v is in range for the element type.
+  assert(i >= 0 && i < packed_len(o));
+  if (o.ref_type() == t_Packed_Int) {
+    packed_ints(o)[i] = v;
+  } else {
+    assert(v >= 0 && v <= 0xff);
+    packed_bytes(o)[i] = U8(v);
+  }
+}
+
+
+static void write_repr_Packed(CFile f, Obj o, Bool is_quoted) {
+  if (is_quoted) fputs("¿", f);
+  fputs(NO_REPR_PO, f);
+  write_repr_Sym(f, type_name(o.ref_type()), true);
+  for_in(i, packed_len(o)) {
+    fprintf(f, " %ld", packed_el(o, i));
+  }
+  fputs(NO_REPR_PC, f);
+}
+
+
+// host functions.
+
+static Obj packed_res_int(Trace* t, Chars name, Int i) {
+  // Packed-Int elements and the results of wrapping arithmetic may not fit in a tagged Int.
+  exc_check(i >= -max_Int_tagged && i <= max_Int_tagged,
+    "%s: result exceeds the range of Int: %i", name, i);
+  return Obj::with_Int(i);
+}
+
+
+static Bool packed_el_in_range(Obj type, Obj el) {
+  if (!el.is_int()) return false;
+  if (type == t_Packed_Int) return true;
+  Int v = el.int_val();
+  return v >= 0 && v <= 0xff;
+}
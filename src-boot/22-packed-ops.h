@@ -0,0 +1,495 @@
+// Copyright 2014 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+// bulk kernels over packed arrays.
+// every kernel has a scalar implementation; on x86-64 most also have SSE2 and AVX2 variants.
+// the widest level that the cpu supports is selected at startup.
+// Int arithmetic wraps on overflow, as the vector instructions do;
+// the scalar variants therefore compute with Uns.
+
+#include "21-packed.h"
+
+
+#if ARCH_64_WORD && defined(__x86_64__)
+#define PACKED_SIMD 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PACKED_SIMD 0
+#endif
+
+
+enum Simd_level {
+  simd_scalar,
+  simd_sse2,
+  simd_avx2,
+};
+
+static Simd_level simd_level_max = simd_scalar; // set by packed_ops_init.
+static Simd_level simd_level = simd_scalar; // may be lowered to test the narrower variants.
+
+
+static void packed_ops_init() {
+#if PACKED_SIMD
+  __builtin_cpu_init();
+  // SSE2 is part of the x86-64 baseline; AVX2 must be detected.
+  simd_level_max = __builtin_cpu_supports("avx2") ? simd_avx2 : simd_sse2;
+#endif
+  simd_level = simd_level_max;
+}
+
+
+// comparisons are decomposed into equality or greater-than,
+// with the operands optionally swapped and the result optionally inverted.
+struct Cmp_op {
+  Bool is_eq;
+  Bool is_swapped;
+  Bool is_inverted;
+};
+
+
+#if PACKED_SIMD
+#define LOAD_128(p) _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+#define LOAD_256(p) _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+#define STORE_128(p, v) _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v)
+#define STORE_256(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v)
+
+static Uns hsum_epi64(__m128i v) {
+  return Uns(_mm_cvtsi128_si64(v)) + Uns(_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)));
+}
+
+TARGET_AVX2 static __m128i fold_256(__m256i v) {
+  return _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+#endif
+
+
+// sum.
+
+static Int sum_ints_scalar(const Int* a, Int n) {
+  Uns s = 0;
+  for_in(i, n) {
+    s += Uns(a[i]);
+  }
+  return Int(s);
+}
+
+#if PACKED_SIMD
+static Int sum_ints_sse2(const Int* a, Int n) {
+  __m128i acc = _mm_setzero_si128();
+  Int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_add_epi64(acc, LOAD_128(a + i));
+  }
+  return Int(hsum_epi64(acc) + Uns(sum_ints_scalar(a + i, n - i)));
+}
+
+TARGET_AVX2 static Int sum_ints_avx2(const Int* a, Int n) {
+  __m256i acc = _mm256_setzero_si256();
+  Int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(acc, LOAD_256(a + i));
+  }
+  return Int(hsum_epi64(fold_256(acc)) + Uns(sum_ints_scalar(a + i, n - i)));
+}
+#endif
+
+static Int sum_ints(const Int* a, Int n) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) return sum_ints_avx2(a, n);
+  if (simd_level >= simd_sse2) return sum_ints_sse2(a, n);
+#endif
+  return sum_ints_scalar(a, n);
+}
+
+
+static Int sum_bytes_scalar(const U8* a, Int n) {
+  Int s = 0;
+  for_in(i, n) {
+    s += a[i];
+  }
+  return s;
+}
+
+#if PACKED_SIMD
+static Int sum_bytes_sse2(const U8* a, Int n) {
+  // psadbw against zero sums each group of eight bytes into a 64-bit lane.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  Int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(LOAD_128(a + i), zero));
+  }
+  return Int(hsum_epi64(acc)) + sum_bytes_scalar(a + i, n - i);
+}
+
+TARGET_AVX2 static Int sum_bytes_avx2(const U8* a, Int n) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  Int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(LOAD_256(a + i), zero));
+  }
+  return Int(hsum_epi64(fold_256(acc))) + sum_bytes_scalar(a + i, n - i);
+}
+#endif
+
+static Int sum_bytes(const U8* a, Int n) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) return sum_bytes_avx2(a, n);
+  if (simd_level >= simd_sse2) return sum_bytes_sse2(a, n);
+#endif
+  return sum_bytes_scalar(a, n);
+}
+
+
+// min and max.
+
+static Int extreme_ints_scalar(const Int* a, Int n, Bool is_max) {
+  assert(n > 0);
+  Int m = a[0];
+  for_imn(i, 1, n) {
+    Int x = a[i];
+    if (is_max ? x > m : x < m) m = x;
+  }
+  return m;
+}
+
+#if PACKED_SIMD
+// SSE2 has no 64-bit comparison, so there is no SSE2 variant.
+TARGET_AVX2 static Int extreme_ints_avx2(const Int* a, Int n, Bool is_max) {
+  if (n < 8) return extreme_ints_scalar(a, n, is_max);
+  __m256i m = LOAD_256(a);
+  Int i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = LOAD_256(a + i);
+    __m256i gt = _mm256_cmpgt_epi64(x, m);
+    m = is_max ? _mm256_blendv_epi8(m, x, gt) : _mm256_blendv_epi8(x, m, gt);
+  }
+  Int lanes[4];
+  STORE_256(lanes, m);
+  Int r = extreme_ints_scalar(lanes, 4, is_max);
+  if (i == n) return r;
+  Int tail = extreme_ints_scalar(a + i, n - i, is_max);
+  return is_max ? int_max(r, tail) : int_min(r, tail);
+}
+#endif
+
+static Int extreme_ints(const Int* a, Int n, Bool is_max) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) return extreme_ints_avx2(a, n, is_max);
+#endif
+  return extreme_ints_scalar(a, n, is_max);
+}
+
+
+static Int extreme_bytes_scalar(const U8* a, Int n, Bool is_max) {
+  assert(n > 0);
+  U8 m = a[0];
+  for_imn(i, 1, n) {
+    U8 x = a[i];
+    if (is_max ? x > m : x < m) m = x;
+  }
+  return m;
+}
+
+#if PACKED_SIMD
+static Int extreme_bytes_sse2(const U8* a, Int n, Bool is_max) {
+  if (n < 32) return extreme_bytes_scalar(a, n, is_max);
+  __m128i m = LOAD_128(a);
+  Int i = 16;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = LOAD_128(a + i);
+    m = is_max ? _mm_max_epu8(m, x) : _mm_min_epu8(m, x);
+  }
+  U8 lanes[16];
+  STORE_128(lanes, m);
+  Int r = extreme_bytes_scalar(lanes, 16, is_max);
+  if (i == n) return r;
+  Int tail = extreme_bytes_scalar(a + i, n - i, is_max);
+  return is_max ? int_max(r, tail) : int_min(r, tail);
+}
+
+TARGET_AVX2 static Int extreme_bytes_avx2(const U8* a, Int n, Bool is_max) {
+  if (n < 64) return extreme_bytes_scalar(a, n, is_max);
+  __m256i m = LOAD_256(a);
+  Int i = 32;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = LOAD_256(a + i);
+    m = is_max ? _mm256_max_epu8(m, x) : _mm256_min_epu8(m, x);
+  }
+  U8 lanes[32];
+  STORE_256(lanes, m);
+  Int r = extreme_bytes_scalar(lanes, 32, is_max);
+  if (i == n) return r;
+  Int tail = extreme_bytes_scalar(a + i, n - i, is_max);
+  return is_max ? int_max(r, tail) : int_min(r, tail);
+}
+#endif
+
+static Int extreme_bytes(const U8* a, Int n, Bool is_max) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) return extreme_bytes_avx2(a, n, is_max);
+  if (simd_level >= simd_sse2) return extreme_bytes_sse2(a, n, is_max);
+#endif
+  return extreme_bytes_scalar(a, n, is_max);
+}
+
+
+// elementwise arithmetic; the right operand is the array b, or the scalar s if b is null.
+
+enum Arith_op {
+  arith_add,
+  arith_sub,
+  arith_mul,
+};
+
+static void arith_ints_scalar(Arith_op op, const Int* a, const Int* b, Int s, Int* out, Int n) {
+  #define ARITH_LOOP(op_token) \
+  for_in(i, n) { \
+    out[i] = Int(Uns(a[i]) op_token Uns(b ? b[i] : s)); \
+  }
+  switch (op) {
+    case arith_add: ARITH_LOOP(+); break;
+    case arith_sub: ARITH_LOOP(-); break;
+    case arith_mul: ARITH_LOOP(*); break;
+  }
+  #undef ARITH_LOOP
+}
+
+#if PACKED_SIMD
+// neither SSE2 nor AVX2 has a 64-bit lane multiply, so mul always uses the scalar loop.
+static void arith_ints_sse2(Arith_op op, const Int* a, const Int* b, Int s, Int* out, Int n) {
+  Int i = 0;
+  if (op != arith_mul) {
+    const __m128i vs = _mm_set1_epi64x(s);
+    for (; i + 2 <= n; i += 2) {
+      __m128i x = LOAD_128(a + i);
+      __m128i y = b ? LOAD_128(b + i) : vs;
+      STORE_128(out + i, op == arith_add ? _mm_add_epi64(x, y) : _mm_sub_epi64(x, y));
+    }
+  }
+  arith_ints_scalar(op, a + i, b ? b + i : null, s, out + i, n - i);
+}
+
+TARGET_AVX2 static void arith_ints_avx2(Arith_op op, const Int* a, const Int* b, Int s, Int* out,
+  Int n) {
+  Int i = 0;
+  if (op != arith_mul) {
+    const __m256i vs = _mm256_set1_epi64x(s);
+    for (; i + 4 <= n; i += 4) {
+      __m256i x = LOAD_256(a + i);
+      __m256i y = b ? LOAD_256(b + i) : vs;
+      STORE_256(out + i, op == arith_add ? _mm256_add_epi64(x, y) : _mm256_sub_epi64(x, y));
+    }
+  }
+  arith_ints_scalar(op, a + i, b ? b + i : null, s, out + i, n - i);
+}
+#endif
+
+static void arith_ints(Arith_op op, const Int* a, const Int* b, Int s, Int* out, Int n) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) { arith_ints_avx2(op, a, b, s, out, n); return; }
+  if (simd_level >= simd_sse2) { arith_ints_sse2(op, a, b, s, out, n); return; }
+#endif
+  arith_ints_scalar(op, a, b, s, out, n);
+}
+
+
+// comparison masks; each output byte is 1 where the comparison holds, and 0 elsewhere.
+
+static void mask_ints_scalar(Cmp_op op, const Int* a, const Int* b, Int s, U8* out, Int n) {
+  for_in(i, n) {
+    Int x = a[i];
+    Int y = b ? b[i] : s;
+    if (op.is_swapped) {
+      Int tmp = x;
+      x = y;
+      y = tmp;
+    }
+    Bool r = op.is_eq ? x == y : x > y;
+    out[i] = U8(r != op.is_inverted);
+  }
+}
+
+#if PACKED_SIMD
+// SSE2 has no 64-bit comparison, so there is no SSE2 variant.
+TARGET_AVX2 static void mask_ints_avx2(Cmp_op op, const Int* a, const Int* b, Int s, U8* out,
+  Int n) {
+  const __m256i vs = _mm256_set1_epi64x(s);
+  const U32 inv_bits = op.is_inverted ? 0xf : 0;
+  Int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = LOAD_256(a + i);
+    __m256i y = b ? LOAD_256(b + i) : vs;
+    if (op.is_swapped) {
+      __m256i tmp = x;
+      x = y;
+      y = tmp;
+    }
+    __m256i m = op.is_eq ? _mm256_cmpeq_epi64(x, y) : _mm256_cmpgt_epi64(x, y);
+    U32 bits = U32(_mm256_movemask_pd(_mm256_castsi256_pd(m))) ^ inv_bits;
+    for_in(j, 4) {
+      out[i + j] = U8((bits >> j) & 1);
+    }
+  }
+  mask_ints_scalar(op, a + i, b ? b + i : null, s, out + i, n - i);
+}
+#endif
+
+static void mask_ints(Cmp_op op, const Int* a, const Int* b, Int s, U8* out, Int n) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) { mask_ints_avx2(op, a, b, s, out, n); return; }
+#endif
+  mask_ints_scalar(op, a, b, s, out, n);
+}
+
+
+static void mask_bytes_scalar(Cmp_op op, const U8* a, const U8* b, U8 s, U8* out, Int n) {
+  for_in(i, n) {
+    U8 x = a[i];
+    U8 y = b ? b[i] : s;
+    if (op.is_swapped) {
+      U8 tmp = x;
+      x = y;
+      y = tmp;
+    }
+    Bool r = op.is_eq ? x == y : x > y;
+    out[i] = U8(r != op.is_inverted);
+  }
+}
+
+#if PACKED_SIMD
+// the vector byte comparisons are signed, so unsigned order is obtained by flipping the sign bits.
+static void mask_bytes_sse2(Cmp_op op, const U8* a, const U8* b, U8 s, U8* out, Int n) {
+  const __m128i vs = _mm_set1_epi8(Char(s));
+  const __m128i sign = _mm_set1_epi8(Char(0x80));
+  const __m128i inv = op.is_inverted ? _mm_set1_epi8(Char(0xff)) : _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  Int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = LOAD_128(a + i);
+    __m128i y = b ? LOAD_128(b + i) : vs;
+    if (op.is_swapped) {
+      __m128i tmp = x;
+      x = y;
+      y = tmp;
+    }
+    __m128i m = op.is_eq ? _mm_cmpeq_epi8(x, y)
+    : _mm_cmpgt_epi8(_mm_xor_si128(x, sign), _mm_xor_si128(y, sign));
+    STORE_128(out + i, _mm_and_si128(_mm_xor_si128(m, inv), one));
+  }
+  mask_bytes_scalar(op, a + i, b ? b + i : null, s, out + i, n - i);
+}
+
+TARGET_AVX2 static void mask_bytes_avx2(Cmp_op op, const U8* a, const U8* b, U8 s, U8* out,
+  Int n) {
+  const __m256i vs = _mm256_set1_epi8(Char(s));
+  const __m256i sign = _mm256_set1_epi8(Char(0x80));
+  const __m256i inv = op.is_inverted ? _mm256_set1_epi8(Char(0xff)) : _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  Int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = LOAD_256(a + i);
+    __m256i y = b ? LOAD_256(b + i) : vs;
+    if (op.is_swapped) {
+      __m256i tmp = x;
+      x = y;
+      y = tmp;
+    }
+    __m256i m = op.is_eq ? _mm256_cmpeq_epi8(x, y)
+    : _mm256_cmpgt_epi8(_mm256_xor_si256(x, sign), _mm256_xor_si256(y, sign));
+    STORE_256(out + i, _mm256_and_si256(_mm256_xor_si256(m, inv), one));
+  }
+  mask_bytes_scalar(op, a + i, b ? b + i : null, s, out + i, n - i);
+}
+#endif
+
+static void mask_bytes(Cmp_op op, const U8* a, const U8* b, U8 s, U8* out, Int n) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) { mask_bytes_avx2(op, a, b, s, out, n); return; }
+  if (simd_level >= simd_sse2) { mask_bytes_sse2(op, a, b, s, out, n); return; }
+#endif
+  mask_bytes_scalar(op, a, b, s, out, n);
+}
+
+
+// prefix sum; each element is a loop-carried dependency, so there are no vector variants.
+
+static void prefix_sum_ints(const Int* a, Int* out, Int n) {
+  Uns s = 0;
+  for_in(i, n) {
+    s += Uns(a[i]);
+    out[i] = Int(s);
+  }
+}
+
+
+static void prefix_sum_bytes(const U8* a, Int* out, Int n) {
+  Int s = 0;
+  for_in(i, n) {
+    s += a[i];
+    out[i] = s;
+  }
+}
+
+
+// find-first; returns the index of the first element equal to v, or -1.
+
+static Int find_ints_scalar(const Int* a, Int n, Int v) {
+  for_in(i, n) {
+    if (a[i] == v) return i;
+  }
+  return -1;
+}
+
+#if PACKED_SIMD
+static Int find_ints_sse2(const Int* a, Int n, Int v) {
+  // SSE2 has no 64-bit equality; a lane is equal when both of its 32-bit halves are equal.
+  const __m128i vv = _mm_set1_epi64x(v);
+  Int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i eq32 = _mm_cmpeq_epi32(LOAD_128(a + i), vv);
+    __m128i eq64 = _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+    I32 bits = _mm_movemask_pd(_mm_castsi128_pd(eq64));
+    if (bits) return i + __builtin_ctz(U32(bits));
+  }
+  Int j = find_ints_scalar(a + i, n - i, v);
+  return j < 0 ? j : i + j;
+}
+
+TARGET_AVX2 static Int find_ints_avx2(const Int* a, Int n, Int v) {
+  const __m256i vv = _mm256_set1_epi64x(v);
+  Int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i eq = _mm256_cmpeq_epi64(LOAD_256(a + i), vv);
+    I32 bits = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+    if (bits) return i + __builtin_ctz(U32(bits));
+  }
+  Int j = find_ints_scalar(a + i, n - i, v);
+  return j < 0 ? j : i + j;
+}
+#endif
+
+static Int find_ints(const Int* a, Int n, Int v) {
+#if PACKED_SIMD
+  if (simd_level >= simd_avx2) return find_ints_avx2(a, n, v);
+  if (simd_level >= simd_sse2) return find_ints_sse2(a, n, v);
+#endif
+  return find_ints_scalar(a, n, v);
+}
+
+
+static Int find_bytes(const U8* a, Int n, Int v) {
+  // the C library memchr is already vectorized.
+  if (v < 0 || v > 0xff || !n) return -1;
+  const U8* p = static_cast<const U8*>(memchr(a, I32(v), Uns(n)));
+  return p ? p - a : -1;
+}
+
+
+#if PACKED_SIMD
+#undef LOAD_128
+#undef LOAD_256
+#undef STORE_128
+#undef STORE_256
+#endif
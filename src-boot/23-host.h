@@ -0,0 +1,903 @@
+// Copyright 2013 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+#include "22-packed-ops.h"
+
+#define GET_VAL(v) Obj v = env_get(env, s_##v)
+#define GET_A GET_VAL(a)
+#define GET_AB GET_A; GET_VAL(b)
+#define GET_ABC GET_AB; GET_VAL(c)
+#define GET_ABCD GET_ABC; GET_VAL(d)
+
+static Obj host_identity(UNUSED Trace* t, Obj env) {
+  GET_A;
+  return a.ret();
+}
+
+
+static Obj host_is(UNUSED Trace* t, Obj env) {
+  GET_AB;
+  return Obj::with_Bool(a == b);
+}
+
+
+static Obj host_is_ref(UNUSED Trace* t, Obj env) {
+  GET_A;
+  return Obj::with_Bool(a.is_ref());
+}
+
+
+static Obj host_is_true(UNUSED Trace* t, Obj env) {
+  GET_A;
+  return Obj::with_Bool(a.is_true());
+}
+
+
+static Obj host_not(UNUSED Trace* t, Obj env) {
+  GET_A;
+  return Obj::with_Bool(!a.is_true());
+}
+
+
+static Obj host_id_hash(UNUSED Trace* t, Obj env) {
+  GET_A;
+  return Obj::with_Int(a.id_hash());
+}
+
+
+static Obj host_ineg(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_int(), "ineg requires Int; received: %o", a);
+  Int i = a.int_val();
+  return Obj::with_Int(-i);
+}
+
+
+static Obj host_iabs(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_int(), "iabs requires Int; received: %o", a);
+  Int i = a.int_val();
+  return Obj::with_Int(i < 0 ? -i : i);
+}
+
+
+// TODO: check for overflow. currently we rely on clang to insert overflow traps.
+#define HOST_BIN_OP(type_name, op) \
+static Obj host_##op(Trace* t, Obj env) { \
+  GET_AB; \
+  exc_check(a.is_int(), #op " requires arg 1 to be a Int; received: %o", a); \
+  exc_check(b.is_int(), #op " requires arg 2 to be a Int; received: %o", b); \
+  Int i = op(a.int_val(), b.int_val()); \
+  return Obj::with_##type_name(i); \
+}
+
+
+static Int iadd(Int a, Int b)  { return a + b; }
+static Int isub(Int a, Int b)  { return a - b; }
+static Int imul(Int a, Int b)  { return a * b; }
+static Int idiv(Int a, Int b)  { return a / b; }
+static Int imod(Int a, Int b)  { return (a % b + b) % b; }
+static Int ipow(Int a, Int b)  { return Int(pow(a, b)); } // TODO: check for overflow.
+static Int ishl(Int a, Int b)  { return a << b; }
+static Int ishr(Int a, Int b)  { return a >> b; }
+
+static Int ieq(Int a, Int b)   { return a == b; }
+static Int ine(Int a, Int b)   { return a != b; }
+static Int ilt(Int a, Int b)   { return a < b; }
+static Int igt(Int a, Int b)   { return a > b; }
+static Int ile(Int a, Int b)   { return a <= b; }
+static Int ige(Int a, Int b)   { return a >= b; }
+
+HOST_BIN_OP(Int, iadd)
+HOST_BIN_OP(Int, isub)
+HOST_BIN_OP(Int, imul)
+HOST_BIN_OP(Int, idiv)
+HOST_BIN_OP(Int, imod)
+HOST_BIN_OP(Int, ipow)
+HOST_BIN_OP(Int, ishl)
+HOST_BIN_OP(Int, ishr)
+
+HOST_BIN_OP(Bool, ieq)
+HOST_BIN_OP(Bool, ine)
+HOST_BIN_OP(Bool, ilt)
+HOST_BIN_OP(Bool, igt)
+HOST_BIN_OP(Bool, ile)
+HOST_BIN_OP(Bool, ige)
+
+
+static Obj host_dlen(Trace* t, Obj env) {
+  GET_A;
+  Int l;
+  if (a == blank) {
+    l = 0;
+  } else {
+    exc_check(a.is_data(), "dlen requires Data; received: %o", a);
+    l = a.data_len();
+  }
+  return Obj::with_Int(l);
+}
+
+
+static Obj host_data_ref_iso(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_data_ref(), "data-ref-iso requires arg 1 to be a Data ref; received: %o",
+    a);
+  exc_check(a.is_data_ref(), "data-ref-iso requires arg 1 to be a Data ref; received: %o",
+    a);
+  return Obj::with_Bool(a.data_ref_iso(b));
+}
+
+
+static Obj host_cmpd_len(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_cmpd(), "cmpd-len requires Cmpd; received: %o", a);
+  Int l = a.cmpd_len();
+  return Obj::with_Int(l);
+}
+
+
+static Obj host_cmpd_el(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_cmpd(), "cmpd-el requires arg 1 to be a Cmpd; received: %o", a);
+  exc_check(b.is_int(), "cmpd-el requires arg 2 to be an Int; received: %o", b);
+  Int l = a.cmpd_len();
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "cmpd-el index out of range; index: %i; len: %i", i, l);
+  Obj field = a.cmpd_el(i);
+  return field.ret();
+}
+
+
+static Obj host_cmpd_put(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_cmpd(), "cmpd-put requires arg 1 to be a Cmpd; received: %o", a);
+  exc_check(b.is_int(), "cmpd-put requires arg 2 to be a Int; received: %o", b);
+  Int l = a.cmpd_len();
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "cmpd-put index out of range; index: %i; len: %i", i, l);
+  func_dec_invalidate(a);
+  a.cmpd_el_move(i).rel();
+  a.cmpd_put(i, c.ret());
+  return a.ret();
+}
+
+
+static Obj host_ael(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_cmpd(), "ael requires arg 1 to be an Arr; received: %o", a);
+  exc_check(b.is_int(), "ael requires arg 2 to be a Int; received: %o", b);
+  Int l = a.cmpd_len();
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "ael index out of range; index: %i; len: %i", i, l);
+  Obj el = a.cmpd_el(i);
+  return el.ret();
+}
+
+
+static Obj host_anew(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_type(), "anew requires arg 1 to be a Type; received: %o", a);
+  exc_check(b.is_int(), "anew requires arg 2 to be an Int; received: %o", b);
+  Int len = b.int_val();
+  Obj res = Obj::Cmpd_raw(a.ret(), len);
+  for_in(i, len) {
+    res.cmpd_put(i, s_UNINIT.ret_val());
+  }
+  return res;
+}
+
+
+static Obj host_aput(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_cmpd(), "aput requires arg 1 to be a Arr; received: %o", a);
+  exc_check(b.is_int(), "aput requires arg 2 to be a Int; received: %o", b);
+  Int l = a.cmpd_len();
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "aput index out of range; index: %i; len: %i", i, l);
+  func_dec_invalidate(a);
+  a.cmpd_el_move(i).rel();
+  a.cmpd_put(i, c.ret());
+  return a.ret();
+}
+
+
+static Obj host_aslice(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_cmpd(), "aslice requires arg 1 to be a Arr; received: %o", a);
+  exc_check(b.is_int(), "aslice requires arg 2 to be a Int; received: %o", b);
+  exc_check(c.is_int(), "aslice requires arg 3 to be a Int; received: %o", c);
+  Int fr = b.int_val();
+  Int to = c.int_val();
+  return a.cmpd_slice(fr, to);
+}
+
+
+static Obj host_acopy(Trace* t, Obj env) {
+  // replace the first c elements of a with those of b; returns a.
+  GET_ABC;
+  exc_check(a.is_cmpd(), "acopy requires arg 1 to be a Arr; received: %o", a);
+  exc_check(b.is_cmpd(), "acopy requires arg 2 to be a Arr; received: %o", b);
+  exc_check(c.is_int(), "acopy requires arg 3 to be a Int; received: %o", c);
+  Int len = c.int_val();
+  exc_check(len >= 0, "acopy len is negative: %i", len);
+  exc_check(a.cmpd_len() >= len, "acopy: dst is smaller than len: %i", len);
+  exc_check(b.cmpd_len() >= len, "acopy: src is smaller than len: %i", len);
+  Obj* dst = a.cmpd_els();
+  Obj* src = b.cmpd_els();
+  func_dec_invalidate(a);
+  Obj::ret_els(src, len); // retain before releasing, in case a and b are the same array.
+  for_in(i, len) {
+    dst[i].rel();
+  }
+  memmove(dst, src, Uns(len * size_Obj));
+  return a.ret();
+}
+
+
+static Obj host_list_alloc(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_int(), "list-alloc requires arg 1 to be an Int; received: %o", a);
+  Int cap = a.int_val();
+  exc_check(cap >= 0, "list-alloc capacity is negative: %i", cap);
+  return List_new(cap);
+}
+
+
+static Obj host_list_len(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_list(), "list-len requires arg 1 to be a List; received: %o", a);
+  return Obj::with_Int(a.lr->list.len());
+}
+
+
+static Obj host_list_el(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_list(), "list-el requires arg 1 to be a List; received: %o", a);
+  exc_check(b.is_int(), "list-el requires arg 2 to be an Int; received: %o", b);
+  List& l = a.lr->list;
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l.len(), "list-el index out of range; index: %i; len: %i", i, l.len());
+  return l.el(i).ret();
+}
+
+
+static Obj host_list_put(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_list(), "list-put requires arg 1 to be a List; received: %o", a);
+  exc_check(b.is_int(), "list-put requires arg 2 to be an Int; received: %o", b);
+  List& l = a.lr->list;
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l.len(), "list-put index out of range; index: %i; len: %i", i, l.len());
+  l.el_move(i).rel();
+  l.put(i, c.ret());
+  return a.ret();
+}
+
+
+static Obj host_list_append(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_list(), "list-append requires arg 1 to be a List; received: %o", a);
+  a.lr->list.append(b.ret());
+  return a.ret();
+}
+
+
+static Obj host_list_insert(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_list(), "list-insert requires arg 1 to be a List; received: %o", a);
+  exc_check(b.is_int(), "list-insert requires arg 2 to be an Int; received: %o", b);
+  List& l = a.lr->list;
+  Int i = b.int_val();
+  exc_check(i >= 0 && i <= l.len(), "list-insert index out of range; index: %i; len: %i",
+    i, l.len());
+  l.insert(i, c.ret());
+  return a.ret();
+}
+
+
+static Obj host_list_pop(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_list(), "list-pop requires arg 1 to be a List; received: %o", a);
+  exc_check(a.lr->list.len() > 0, "list-pop: list is empty");
+  return a.lr->list.pop();
+}
+
+
+static Obj host_list_extend(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_list(), "list-extend requires arg 1 to be a List; received: %o", a);
+  List& l = a.lr->list;
+  if (b.is_list()) {
+    List& src = b.lr->list;
+    Int len = src.len(); // a list may extend itself, so read len before appending.
+    l.reserve(l.len() + len);
+    l.extend(src.begin(), len);
+  } else {
+    exc_check(b.is_cmpd(), "list-extend requires arg 2 to be a List or Arr; received: %o", b);
+    l.extend(b.cmpd_els(), b.cmpd_len());
+  }
+  return a.ret();
+}
+
+
+#define CHECK_KEY(name, k) \
+exc_check(k.is_int() || k.is_data(), name " requires key to be an Int or Data; received: %o", k)
+
+
+static Obj host_btree_new(UNUSED Trace* t, UNUSED Obj env) {
+  return Btree_new();
+}
+
+
+static Obj host_btree_len(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_btree(), "btree-len requires arg 1 to be a Btree; received: %o", a);
+  return Obj::with_Int(a.bt->tree.len());
+}
+
+
+static Obj host_btree_get(Trace* t, Obj env) {
+  // get the val for key b, or the default c.
+  GET_ABC;
+  exc_check(a.is_btree(), "btree-get requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-get", b);
+  Obj val = a.bt->tree.fetch(b);
+  return (val.vld() ? val : c).ret();
+}
+
+
+static Obj host_btree_has(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_btree(), "btree-has requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-has", b);
+  return Obj::with_Bool(a.bt->tree.fetch(b).vld());
+}
+
+
+static Obj host_btree_put(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_btree(), "btree-put requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-put", b);
+  Obj old = a.bt->tree.insert(b.ret(), c.ret());
+  if (old.vld()) old.rel();
+  return a.ret();
+}
+
+
+static Obj host_btree_remove(Trace* t, Obj env) {
+  // remove key b and return its val, or the default c.
+  GET_ABC;
+  exc_check(a.is_btree(), "btree-remove requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-remove", b);
+  Obj val = a.bt->tree.remove(b);
+  return val.vld() ? val : c.ret();
+}
+
+
+static Obj host_btree_floor(Trace* t, Obj env) {
+  // the greatest key not greater than b, or nil.
+  GET_AB;
+  exc_check(a.is_btree(), "btree-floor requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-floor", b);
+  Obj k = a.bt->tree.floor(b);
+  return k.vld() ? k.ret() : s_nil.ret_val();
+}
+
+
+static Obj host_btree_ceil(Trace* t, Obj env) {
+  // the least key not less than b, or nil.
+  GET_AB;
+  exc_check(a.is_btree(), "btree-ceil requires arg 1 to be a Btree; received: %o", a);
+  CHECK_KEY("btree-ceil", b);
+  Obj k = a.bt->tree.ceil(b);
+  return k.vld() ? k.ret() : s_nil.ret_val();
+}
+
+
+static Obj host_btree_range(Trace* t, Obj env) {
+  // return a List of interleaved keys and vals for keys in [b, c); a nil bound is open.
+  GET_ABC;
+  exc_check(a.is_btree(), "btree-range requires arg 1 to be a Btree; received: %o", a);
+  if (b != s_nil) CHECK_KEY("btree-range", b);
+  if (c != s_nil) CHECK_KEY("btree-range", c);
+  Obj l = List_new(0);
+  a.bt->tree.range(b == s_nil ? obj0 : b, c == s_nil ? obj0 : c, l.lr->list);
+  return l;
+}
+
+
+static Obj host_btree_from_sorted(Trace* t, Obj env) {
+  // build a Btree from an array of strictly increasing keys and an array of vals.
+  GET_AB;
+  exc_check(a.is_cmpd(), "btree-from-sorted requires arg 1 to be an Arr; received: %o", a);
+  exc_check(b.is_cmpd(), "btree-from-sorted requires arg 2 to be an Arr; received: %o", b);
+  Int len = a.cmpd_len();
+  exc_check(len == b.cmpd_len(), "btree-from-sorted: keys len %i does not match vals len %i",
+    len, b.cmpd_len());
+  Obj* keys = a.cmpd_els();
+  for_in(i, len) {
+    CHECK_KEY("btree-from-sorted", keys[i]);
+    exc_check(!i || btree_key_cmp(keys[i - 1], keys[i]) < 0,
+      "btree-from-sorted: keys are not strictly increasing at index %i", i);
+  }
+  Obj tree = Btree_new();
+  if (!len) return tree;
+  Array ks(len);
+  Array vs(len);
+  for_in(i, len) {
+    ks.put(i, keys[i].ret());
+    vs.put(i, b.cmpd_el(i).ret());
+  }
+  tree.bt->tree.load_sorted(ks.els(), vs.els(), len);
+  ks.dealloc(false);
+  vs.dealloc(false);
+  return tree;
+}
+
+#undef CHECK_KEY
+
+
+static Obj host_packed_new(Trace* t, Obj env) {
+  // create a zeroed packed array of type a and len b.
+  GET_AB;
+  exc_check(a == t_Packed_Int || a == t_Packed_Byte,
+    "packed-new requires arg 1 to be a Packed type; received: %o", a);
+  exc_check(b.is_int(), "packed-new requires arg 2 to be an Int; received: %o", b);
+  Int len = b.int_val();
+  exc_check(len >= 0, "packed-new len is negative: %i", len);
+  return Packed_new(a.ret(), len);
+}
+
+
+static Obj host_packed_len(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_packed(), "packed-len requires arg 1 to be a Packed array; received: %o", a);
+  return Obj::with_Int(packed_len(a));
+}
+
+
+static Obj host_packed_el(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_packed(), "packed-el requires arg 1 to be a Packed array; received: %o", a);
+  exc_check(b.is_int(), "packed-el requires arg 2 to be an Int; received: %o", b);
+  Int l = packed_len(a);
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "packed-el index out of range; index: %i; len: %i", i, l);
+  return packed_res_int(t, "packed-el", packed_el(a, i));
+}
+
+
+static Obj host_packed_put(Trace* t, Obj env) {
+  GET_ABC;
+  exc_check(a.is_packed(), "packed-put requires arg 1 to be a Packed array; received: %o", a);
+  exc_check(b.is_int(), "packed-put requires arg 2 to be an Int; received: %o", b);
+  Int l = packed_len(a);
+  Int i = b.int_val();
+  exc_check(i >= 0 && i < l, "packed-put index out of range; index: %i; len: %i", i, l);
+  exc_check(packed_el_in_range(a.ref_type(), c),
+    "packed-put: element is not valid for %o: %o", type_name(a.ref_type()), c);
+  packed_put(a, i, c.int_val());
+  return a.ret();
+}
+
+
+static Obj host_packed_from_arr(Trace* t, Obj env) {
+  // create a packed array of type a from the Int elements of array b, e.g. an Arr-Obj.
+  GET_AB;
+  exc_check(a == t_Packed_Int || a == t_Packed_Byte,
+    "packed-from-arr requires arg 1 to be a Packed type; received: %o", a);
+  exc_check(b.is_cmpd(), "packed-from-arr requires arg 2 to be an Arr; received: %o", b);
+  Int len = b.cmpd_len();
+  Obj* els = b.cmpd_els();
+  for_in(i, len) {
+    exc_check(packed_el_in_range(a, els[i]),
+      "packed-from-arr: element %i is not valid for %o: %o", i, type_name(a), els[i]);
+  }
+  Obj p = Packed_new(a.ret(), len);
+  if (a == t_Packed_Int) {
+    Int* ints = packed_ints(p);
+    for_in(i, len) {
+      ints[i] = els[i].int_val();
+    }
+  } else {
+    U8* bytes = packed_bytes(p);
+    for_in(i, len) {
+      bytes[i] = U8(els[i].int_val());
+    }
+  }
+  return p;
+}
+
+
+static Obj host_packed_to_arr(Trace* t, Obj env) {
+  // create an Arr-Obj containing the elements of packed array a.
+  GET_A;
+  exc_check(a.is_packed(), "packed-to-arr requires arg 1 to be a Packed array; received: %o", a);
+  Int len = packed_len(a);
+  for_in(i, len) {
+    Int el = packed_el(a, i);
+    exc_check(el >= -max_Int_tagged && el <= max_Int_tagged,
+      "packed-to-arr: element %i exceeds the range of Int: %i", i, el);
+  }
+  Obj arr = Obj::Cmpd_raw(t_Arr_Obj.ret(), len);
+  for_in(i, len) {
+    arr.cmpd_put(i, Obj::with_Int(packed_el(a, i)));
+  }
+  return arr;
+}
+
+
+static Obj host_packed_sum(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_packed(), "packed-sum requires arg 1 to be a Packed array; received: %o", a);
+  Int n = packed_len(a);
+  if (a.ref_type() == t_Packed_Int) {
+    return packed_res_int(t, "packed-sum", sum_ints(packed_ints(a), n));
+  }
+  return Obj::with_Int(sum_bytes(packed_bytes(a), n));
+}
+
+
+static Obj packed_extreme(Trace* t, Obj a, Bool is_max) {
+  Chars name = is_max ? "packed-max" : "packed-min";
+  exc_check(a.is_packed(), "%s requires arg 1 to be a Packed array; received: %o", name, a);
+  Int n = packed_len(a);
+  exc_check(n > 0, "%s requires a non-empty array", name);
+  if (a.ref_type() == t_Packed_Int) {
+    return packed_res_int(t, name, extreme_ints(packed_ints(a), n, is_max));
+  }
+  return Obj::with_Int(extreme_bytes(packed_bytes(a), n, is_max));
+}
+
+
+static Obj host_packed_min(Trace* t, Obj env) {
+  GET_A;
+  return packed_extreme(t, a, false);
+}
+
+
+static Obj host_packed_max(Trace* t, Obj env) {
+  GET_A;
+  return packed_extreme(t, a, true);
+}
+
+
+static Obj packed_arith(Trace* t, Obj a, Obj b, Arith_op op, Chars name) {
+  // b is either an Int or a Packed-Int of the same len as a.
+  exc_check(a.is_packed() && a.ref_type() == t_Packed_Int,
+    "%s requires arg 1 to be a Packed-Int; received: %o", name, a);
+  Int n = packed_len(a);
+  if (!b.is_int()) {
+    exc_check(b.is_packed() && b.ref_type() == t_Packed_Int,
+      "%s requires arg 2 to be an Int or Packed-Int; received: %o", name, b);
+    exc_check(packed_len(b) == n, "%s: array lengths differ: %i, %i", name, n, packed_len(b));
+  }
+  Obj res = Packed_new(t_Packed_Int.ret(), n);
+  if (b.is_int()) {
+    arith_ints(op, packed_ints(a), null, b.int_val(), packed_ints(res), n);
+  } else {
+    arith_ints(op, packed_ints(a), packed_ints(b), 0, packed_ints(res), n);
+  }
+  return res;
+}
+
+
+static Obj host_packed_add(Trace* t, Obj env) {
+  GET_AB;
+  return packed_arith(t, a, b, arith_add, "packed-add");
+}
+
+
+static Obj host_packed_sub(Trace* t, Obj env) {
+  GET_AB;
+  return packed_arith(t, a, b, arith_sub, "packed-sub");
+}
+
+
+static Obj host_packed_mul(Trace* t, Obj env) {
+  GET_AB;
+  return packed_arith(t, a, b, arith_mul, "packed-mul");
+}
+
+
+static Obj host_packed_mask(Trace* t, Obj env) {
+  // compare each element of a against c, which is an Int or a packed array of the same type,
+  // using the comparison named by the sym b; returns a Packed-Byte of ones and zeros.
+  GET_ABC;
+  exc_check(a.is_packed(), "packed-mask requires arg 1 to be a Packed array; received: %o", a);
+  Cmp_op op;
+  if (b == s_eq)      op = {true,  false, false};
+  else if (b == s_ne) op = {true,  false, true};
+  else if (b == s_gt) op = {false, false, false};
+  else if (b == s_le) op = {false, false, true};
+  else if (b == s_lt) op = {false, true,  false};
+  else if (b == s_ge) op = {false, true,  true};
+  else exc_raise("packed-mask requires arg 2 to be one of eq, ne, lt, le, gt, ge; received: %o", b);
+  Obj type = a.ref_type();
+  Int n = packed_len(a);
+  if (c.is_int()) {
+    exc_check(type == t_Packed_Int || (c.int_val() >= 0 && c.int_val() <= 0xff),
+      "packed-mask: scalar is out of range for Packed-Byte: %o", c);
+  } else {
+    exc_check(c.is_packed() && c.ref_type() == type,
+      "packed-mask requires arg 3 to be an Int or %o; received: %o", type_name(type), c);
+    exc_check(packed_len(c) == n, "packed-mask: array lengths differ: %i, %i", n, packed_len(c));
+  }
+  Obj res = Packed_new(t_Packed_Byte.ret(), n);
+  if (type == t_Packed_Int) {
+    if (c.is_int()) {
+      mask_ints(op, packed_ints(a), null, c.int_val(), packed_bytes(res), n);
+    } else {
+      mask_ints(op, packed_ints(a), packed_ints(c), 0, packed_bytes(res), n);
+    }
+  } else {
+    if (c.is_int()) {
+      mask_bytes(op, packed_bytes(a), null, U8(c.int_val()), packed_bytes(res), n);
+    } else {
+      mask_bytes(op, packed_bytes(a), packed_bytes(c), 0, packed_bytes(res), n);
+    }
+  }
+  return res;
+}
+
+
+static Obj host_packed_prefix_sum(Trace* t, Obj env) {
+  // returns a Packed-Int of inclusive running sums.
+  GET_A;
+  exc_check(a.is_packed(), "packed-prefix-sum requires arg 1 to be a Packed array; received: %o",
+    a);
+  Int n = packed_len(a);
+  Obj res = Packed_new(t_Packed_Int.ret(), n);
+  if (a.ref_type() == t_Packed_Int) {
+    prefix_sum_ints(packed_ints(a), packed_ints(res), n);
+  } else {
+    prefix_sum_bytes(packed_bytes(a), packed_ints(res), n);
+  }
+  return res;
+}
+
+
+static Obj host_packed_find(Trace* t, Obj env) {
+  // returns the index of the first element equal to b, or -1.
+  GET_AB;
+  exc_check(a.is_packed(), "packed-find requires arg 1 to be a Packed array; received: %o", a);
+  exc_check(b.is_int(), "packed-find requires arg 2 to be an Int; received: %o", b);
+  Int n = packed_len(a);
+  if (a.ref_type() == t_Packed_Int) {
+    return Obj::with_Int(find_ints(packed_ints(a), n, b.int_val()));
+  }
+  return Obj::with_Int(find_bytes(packed_bytes(a), n, b.int_val()));
+}
+
+
+static Obj host_packed_simd_level(UNUSED Trace* t, UNUSED Obj env) {
+  // 0: scalar; 1: SSE2; 2: AVX2.
+  return Obj::with_Int(simd_level);
+}
+
+
+static Obj host_packed_set_simd_level(Trace* t, Obj env) {
+  // lower or restore the kernel level, up to the maximum supported by the cpu;
+  // returns the level in effect.
+  GET_A;
+  exc_check(a.is_int() && a.int_val() >= 0,
+    "packed-set-simd-level requires arg 1 to be a non-negative Int; received: %o", a);
+  simd_level = Simd_level(int_min(a.int_val(), simd_level_max));
+  return Obj::with_Int(simd_level);
+}
+
+
+static Obj host_write(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_ptr(), "write requires arg 1 to be a File; received: %o", a);
+  exc_check(b.is_data(), "write requires arg 2 to be a Data; received: %o", b);
+  CFile file = CFile(a.ptr());
+  // for now, ignore the return value.
+  fwrite(b.data_chars(), size_Char, Uns(b.data_len()), file);
+  return s_void.ret_val();
+}
+
+
+static Obj host_write_repr(Trace* t, Obj env) {
+  GET_AB;
+  exc_check(a.is_ptr(), "write-repr requires arg 1 to be a File; received: %o", a);
+  CFile file = CFile(a.ptr());
+  write_repr(file, b);
+  return s_void.ret_val();
+}
+
+
+static Obj host_flush(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_ptr(), "flush requires arg 1 to be a File; received: %o", a);
+  CFile file = CFile(a.ptr());
+  fflush(file);
+  return s_void.ret_val();
+}
+
+
+static Obj host_exit(Trace* t, Obj env) {
+  GET_A;
+  exc_check(a.is_int(), "exit requires arg 1 to be an Int; recived: %o", a);
+  exit(I32(a.int_val()));
+  // TODO: throw exception to unwind, cleanup, and report counts?
+}
+
+
+static Obj host_raise(Trace* t, Obj env) {
+  GET_A;
+  exc_raise("raised: %o", a);
+}
+
+
+static Obj host_type_of(UNUSED Trace* t, Obj env) {
+  GET_A;
+  Obj type = a.type();
+  return type.ret();
+}
+
+
+static Obj host_globalize(UNUSED Trace* t, Obj env) {
+  GET_A;
+  global_push(a);
+  return a.ret();
+}
+
+
+static Obj host_dbg(Trace* t, Obj env) {
+  GET_AB; // label, obj.
+  exc_check(a.type() == t_Data, "dbg expects argument 1 to be Data: %o", a);
+  write_data(stderr, a);
+  errFL(": %p rc:%u %o", b.r, b.rc(), b);
+  return s_void.ret_val();
+}
+
+
+typedef Obj(*Func_host_ptr)(Trace*, Obj);
+
+
+// defined in 28-run.h.
+static Obj host_dispatcher_put(Trace* t, Obj env);
+static Obj host_memo_func(Trace* t, Obj env);
+static Obj host_memo_stats(Trace* t, Obj env);
+
+
+static Obj host_init_const(Obj env, Chars name, Obj val) {
+  return env_bind(env, false, Obj::Sym_from_c(name), val);
+}
+
+
+static Obj host_init_func(Obj env, Int len_pars, Chars name, Func_host_ptr ptr) {
+  // owns env.
+  Obj sym = Obj::Sym_from_c(name);
+  Obj pars; // TODO: add real types; unique value for expression default?
+  #define PAR(s) \
+  Obj::Cmpd(t_Par.ret(), s.ret_val(), s_nil.ret_val(), s_void.ret_val())
+  switch (len_pars) {
+    case 0: pars = Obj::Cmpd_raw(t_Arr_Par.ret(), 0); break;
+    case 1: pars = Obj::Cmpd(t_Arr_Par.ret(), PAR(s_a)); break;
+    case 2: pars = Obj::Cmpd(t_Arr_Par.ret(), PAR(s_a), PAR(s_b)); break;
+    case 3: pars = Obj::Cmpd(t_Arr_Par.ret(), PAR(s_a), PAR(s_b), PAR(s_c)); break;
+    case 4: pars = Obj::Cmpd(t_Arr_Par.ret(), PAR(s_a), PAR(s_b), PAR(s_c), PAR(s_d)); break;
+    default: assert(0);
+  }
+  #undef PAR
+  Obj f = Obj::Cmpd(t_Func.ret(),
+    Obj::with_Bool(false), // is-native.
+    Obj::with_Bool(false), // is-macro.
+    env.ret(), // env.
+    t_Obj.ret(), // ret-type. TODO: specify actual return type?
+    s_void.ret_val(), // variad.
+    s_void.ret_val(), // assoc.
+    pars, // pars.
+    Obj::with_Ptr(Raw(ptr))); // body.
+  return env_bind(env, false, sym, f);
+}
+
+
+static Obj host_init_file(Obj env, Chars sym_name, Chars name, CFile f, Bool r,
+  Bool w) {
+  // owns env.
+  Obj sym = Obj::Sym(sym_name);
+  Obj val = Obj::Cmpd(t_File.ret(), Obj::Data(name), Obj::with_Ptr(f),
+    Obj::with_Bool(r), Obj::with_Bool(w));
+  return env_bind(env, false, sym, val);
+}
+
+
+static Obj host_init(Obj env) {
+
+#define DEF_CONST(c) env = host_init_const(env, #c, Obj::with_Int(c))
+  DEF_CONST(OPTION_REC_LIMIT);
+  DEF_CONST(OPTION_STACK_LIMIT);
+#undef DEF_CONST
+
+#define DEF_FH(len_pars, n) env = host_init_func(env, len_pars, #n, host_##n)
+  DEF_FH(1, identity);
+  DEF_FH(2, is);
+  DEF_FH(1, is_ref);
+  DEF_FH(1, is_true);
+  DEF_FH(1, not);
+  DEF_FH(1, id_hash);
+  DEF_FH(1, ineg);
+  DEF_FH(1, iabs);
+  DEF_FH(2, iadd);
+  DEF_FH(2, isub);
+  DEF_FH(2, imul);
+  DEF_FH(2, idiv);
+  DEF_FH(2, imod);
+  DEF_FH(2, ipow);
+  DEF_FH(2, ishl);
+  DEF_FH(2, ishr);
+  DEF_FH(2, ieq);
+  DEF_FH(2, ine);
+  DEF_FH(2, ilt);
+  DEF_FH(2, ile);
+  DEF_FH(2, igt);
+  DEF_FH(2, ige);
+  DEF_FH(1, dlen);
+  DEF_FH(2, data_ref_iso);
+  DEF_FH(1, cmpd_len);
+  DEF_FH(2, cmpd_el);
+  DEF_FH(3, cmpd_put);
+  DEF_FH(2, ael);
+  DEF_FH(2, anew);
+  DEF_FH(3, aput);
+  DEF_FH(3, aslice);
+  DEF_FH(3, acopy);
+  DEF_FH(1, list_alloc);
+  DEF_FH(1, list_len);
+  DEF_FH(2, list_el);
+  DEF_FH(3, list_put);
+  DEF_FH(2, list_append);
+  DEF_FH(3, list_insert);
+  DEF_FH(1, list_pop);
+  DEF_FH(2, list_extend);
+  DEF_FH(0, btree_new);
+  DEF_FH(1, btree_len);
+  DEF_FH(3, btree_get);
+  DEF_FH(2, btree_has);
+  DEF_FH(3, btree_put);
+  DEF_FH(3, btree_remove);
+  DEF_FH(2, btree_floor);
+  DEF_FH(2, btree_ceil);
+  DEF_FH(3, btree_range);
+  DEF_FH(2, btree_from_sorted);
+  DEF_FH(2, packed_new);
+  DEF_FH(1, packed_len);
+  DEF_FH(2, packed_el);
+  DEF_FH(3, packed_put);
+  DEF_FH(2, packed_from_arr);
+  DEF_FH(1, packed_to_arr);
+  DEF_FH(1, packed_sum);
+  DEF_FH(1, packed_min);
+  DEF_FH(1, packed_max);
+  DEF_FH(2, packed_add);
+  DEF_FH(2, packed_sub);
+  DEF_FH(2, packed_mul);
+  DEF_FH(3, packed_mask);
+  DEF_FH(1, packed_prefix_sum);
+  DEF_FH(2, packed_find);
+  DEF_FH(0, packed_simd_level);
+  DEF_FH(1, packed_set_simd_level);
+  DEF_FH(2, write);
+  DEF_FH(2, write_repr);
+  DEF_FH(1, flush);
+  DEF_FH(1, exit);
+  DEF_FH(1, raise);
+  DEF_FH(1, type_of);
+  DEF_FH(1, globalize);
+  DEF_FH(2, dbg);
+  DEF_FH(2, dispatcher_put);
+  DEF_FH(4, memo_func);
+  DEF_FH(1, memo_stats);
+#undef DEF_FH
+
+#define DEF_FILE(n, f, r, w) env = host_init_file(env, n, "<" n ">", f, r, w);
+  DEF_FILE("std-in", stdin, true, false)
+  DEF_FILE("std-out", stdout, false, true)
+  DEF_FILE("std-err", stderr, false, true)
+#undef DEF_FILE
+
+  return env;
+}
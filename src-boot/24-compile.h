@@ -1,10 +0,0 @@
-// Copyright 2014 George King.
-// Permission to use this file is granted in ploy/license.txt.
-
-#include "23-expand.h"
-
-
-static Obj compile(UNUSED Obj env, Obj code) {
-  // owns code.
-  return code;
-}
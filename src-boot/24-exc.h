@@ -3,15 +3,20 @@
 
 // exceptions.
 
-#include "20-host.h"
+#include "23-host.h"
 
 
 struct Trace {
-  Obj code;
+  // a frame of the evaluator's control stack, live on the native stack.
+  // code points to the evaluator's own variable for the running code, rather than a copy,
+  // so that tail steps need not update the trace; it is only read when raising.
+  const Obj* code;
   Int elided_step_count;
   Trace* next;
-  Trace(Obj c, Int e, Trace* n): code(c), elided_step_count(e), next(n) {}
-}; // Trace objects are live on the stack only.
+  Bool is_env_abandoned; // set by run_tail when the env of the current step dies with the step.
+  Trace(const Obj* c, Int e, Trace* n):
+    code(c), elided_step_count(e), next(n), is_env_abandoned(false) {}
+};
 
 
 static Dict global_src_locs;
@@ -31,9 +36,10 @@ static Obj track_src(Obj original, Obj derived) {
   // NOTE: there is not yet any exception unwind mechanism, so this just calls exit.
   errL("\ntrace:");
   while (trace) {
-    Obj loc = global_src_locs.fetch(trace->code);
+    Obj code = *trace->code;
+    Obj loc = global_src_locs.fetch(code);
     if (!loc.vld()) {
-      errFL("  %o", trace->code);
+      errFL("  %o", code);
     } else {
       Obj path = loc.cmpd_el(0);
       Obj src = loc.cmpd_el(1);
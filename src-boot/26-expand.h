@@ -1,7 +1,7 @@
 // Copyright 2014 George King.
 // Permission to use this file is granted in ploy/license.txt.
 
-#include "22-pre.h"
+#include "25-pre.h"
 
 
 static Bool cmpd_contains_unquote(Obj c) {
@@ -64,7 +64,7 @@ static Obj expand(Int d, Obj env, Obj code) {
   check(d < OPTION_REC_LIMIT, "macro expansion exceeded recursion limit: %i\n%o",
     Int(OPTION_REC_LIMIT), code);
 #endif
-  Trace trace(code, 0, null);
+  Trace trace(&code, 0, null);
   Trace* t = &trace;
   if (!code.is_cmpd()) {
     return code;
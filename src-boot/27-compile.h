@@ -0,0 +1,991 @@
+// Copyright 2014 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+// compile is an optimization pass over expanded code.
+// it folds calls to pure host functions whose arguments are all constants,
+// eliminates If branches whose predicate is constant,
+// flattens nested expression sequences,
+// inlines calls to small native functions,
+// fuses calls to binary Int host functions into Int-op nodes,
+// and replaces CONS of statically known struct types with Cons-struct nodes.
+// the pass never mutates its input; rewritten nodes are new objects that inherit source locs,
+// while unchanged subtrees are returned as is, so that most code is not reallocated.
+
+#include "26-expand.h"
+
+
+struct Compiler {
+  Obj env; // the env in which the code will run; borrowed.
+  List binds; // syms bound anywhere within the code; these may shadow env at run time.
+  Bool can_fold; // false if the code can bind arbitrary syms at run time, e.g. via RUN.
+  Int inline_depth; // nesting of inlined bodies currently being compiled.
+  List* int_pars; // the pars of the innermost enclosing Fn that are declared Int; or null.
+  Compiler(Obj _env): env(_env), binds(), can_fold(true), inline_depth(0), int_pars(null) {}
+};
+
+
+static void compile_scan_binds(Compiler& c, Obj code) {
+  // collect every sym that the code might bind, conservatively:
+  // Let and Let-vals names, Loop and Each syms, and the names of all Label and Variad nodes,
+  // which include Fn pars.
+  // the contents of Quo are data, but a RUN anywhere could bind them, so disable folding.
+  if (code == s_RUN) {
+    c.can_fold = false;
+    return;
+  }
+  if (!code.is_cmpd()) return;
+  Obj type = code.ref_type();
+  if (type == t_Quo) return;
+  if (type == t_Cons_struct) { // do not walk the type.
+    compile_scan_binds(c, code.cmpd_el(1));
+    return;
+  }
+  if (type == t_Inlined) { // do not walk the Func; the body binds nothing beyond the args.
+    compile_scan_binds(c, code.cmpd_el(0));
+    return;
+  }
+  if (type == t_Let) {
+    Obj exprs = code.cmpd_el(0);
+    if (exprs.cmpd_len() > 0 && exprs.cmpd_el(0).is_sym()) {
+      c.binds.append(exprs.cmpd_el(0).ret_val());
+    }
+  } else if (type == t_Let_vals) {
+    Obj exprs = code.cmpd_el(0);
+    for_in(i, exprs.cmpd_len() - 1) { // the last expr is the value.
+      Obj sym = exprs.cmpd_el(i);
+      if (sym.is_sym()) c.binds.append(sym.ret_val());
+    }
+  } else if (type == t_Loop || type == t_Each) {
+    Obj exprs = code.cmpd_el(0);
+    Int len = exprs.cmpd_len();
+    if (len > 3) {
+      Obj sym = exprs.cmpd_el(0);
+      Obj acc_sym = exprs.cmpd_el(len - 3);
+      if (sym.is_sym()) c.binds.append(sym.ret_val());
+      if (acc_sym.is_sym()) c.binds.append(acc_sym.ret_val());
+    }
+  } else if (type == t_Label || type == t_Variad) {
+    Obj name = code.cmpd_el(0);
+    if (name.is_sym()) {
+      c.binds.append(name.ret_val());
+    }
+  }
+  for_val(el, code.cmpd_it()) {
+    compile_scan_binds(c, el);
+  }
+}
+
+
+static Bool compile_is_const(Obj o) {
+  // true if o is self-evaluating, so that running it has no effect and always yields o.
+  switch (o.tag()) {
+    case ot_int: return true;
+    case ot_sym: return o.is_data_word() || o.is_special_sym();
+    case ot_ref: {
+      Obj type = o.ref_type();
+      return type == t_Data || type == t_Accessor || type == t_Mutator;
+    }
+    default: return false;
+  }
+}
+
+
+static Obj compile_int(Int i) {
+  // returns obj0 if i does not fit in a tagged Int, in which case the call is not folded,
+  // so that the error is raised at run time.
+  if (i < -max_Int_tagged || i > max_Int_tagged) return obj0;
+  return Obj::with_Int(i);
+}
+
+
+static Obj compile_fold_host(Func_host_ptr ptr, Int len_args, Obj* args) {
+  // evaluate a call to a pure host function with constant args.
+  // returns obj0 if the function is not foldable, or if the call might raise;
+  // in either case the call is left for run time.
+  if (len_args == 1) {
+    Obj a = args[0];
+    if (ptr == host_not) return Obj::with_Bool(!a.is_true());
+    if (ptr == host_is_true) return Obj::with_Bool(a.is_true());
+    if (!a.is_int()) return obj0;
+    Int i = a.int_val();
+    if (ptr == host_ineg) return compile_int(-i);
+    if (ptr == host_iabs) return compile_int(i < 0 ? -i : i);
+    return obj0;
+  }
+  if (len_args != 2) return obj0;
+  Obj a = args[0];
+  Obj b = args[1];
+  if (ptr == host_is) return Obj::with_Bool(a == b);
+  if (!a.is_int() || !b.is_int()) return obj0;
+  Int i = a.int_val();
+  Int j = b.int_val();
+  Int r;
+  if (ptr == host_iadd) return __builtin_add_overflow(i, j, &r) ? obj0 : compile_int(r);
+  if (ptr == host_isub) return __builtin_sub_overflow(i, j, &r) ? obj0 : compile_int(r);
+  if (ptr == host_imul) return __builtin_mul_overflow(i, j, &r) ? obj0 : compile_int(r);
+  if (ptr == host_idiv) return j ? compile_int(idiv(i, j)) : obj0;
+  if (ptr == host_imod) return j ? compile_int(imod(i, j)) : obj0;
+  if (ptr == host_ieq) return Obj::with_Bool(ieq(i, j));
+  if (ptr == host_ine) return Obj::with_Bool(ine(i, j));
+  if (ptr == host_ilt) return Obj::with_Bool(ilt(i, j));
+  if (ptr == host_igt) return Obj::with_Bool(igt(i, j));
+  if (ptr == host_ile) return Obj::with_Bool(ile(i, j));
+  if (ptr == host_ige) return Obj::with_Bool(ige(i, j));
+  return obj0;
+}
+
+
+static Func_host_ptr compile_host_ptr(Compiler& c, Obj exprs) {
+  // borrows exprs, the compiled elements of a Call.
+  // returns the host function that the callee resolves to, or null;
+  // the call must pass exactly as many args as the function has pars.
+  if (!c.can_fold) return null;
+  Obj callee = exprs.cmpd_el(0);
+  if (!callee.is_sym() || callee.is_data_word() || callee.is_special_sym()) return null;
+  // the callee must resolve to the host binding; any local binding might shadow it.
+  if (c.binds.contains(callee)) return null;
+  Obj f = env_get(c.env, callee);
+  if (!f.vld() || f.type() != t_Func || f.cmpd_len() != 8) return null;
+  Obj is_native = f.cmpd_el(0);
+  Obj pars = f.cmpd_el(6);
+  Obj body = f.cmpd_el(7);
+  if (is_native != s_false || !body.is_ptr() || pars.type() != t_Arr_Par) return null;
+  if (exprs.cmpd_len() - 1 != pars.cmpd_len()) return null;
+  return reinterpret_cast<Func_host_ptr>(body.ptr());
+}
+
+
+static Obj compile_fold_call(Compiler& c, Obj exprs) {
+  // borrows exprs, the compiled elements of a Call.
+  // returns the folded value, or obj0 if the call cannot be folded.
+  Func_host_ptr ptr = compile_host_ptr(c, exprs);
+  if (!ptr) return obj0;
+  Int len_args = exprs.cmpd_len() - 1;
+  Obj* args = exprs.cmpd_els() + 1;
+  for_in(i, len_args) {
+    if (!compile_is_const(args[i])) return obj0; // also excludes Label and Splice.
+  }
+  return compile_fold_host(ptr, len_args, args);
+}
+
+
+// fused Int operations.
+// a call to one of the binary Int host functions is replaced by an Int-op node,
+// which run_Int_op evaluates directly on the tagged operands, without assembling call vals,
+// binding a frame, or entering the host function.
+// if either operand is not an Int, or the result is not representable,
+// run_Int_op falls back to the generic call, so that errors are unchanged.
+// the node retains the original Call, which provides the operands and the fallback callee,
+// and is what write_repr shows.
+// if both operands are Int literals or pars of the enclosing Fn that are declared Int,
+// then the op is specialized with ioi_flag_ints, and run_Int_op omits the operand tag checks;
+// bind_check_type guarantees the par values, and a par cannot be rebound within its frame.
+
+enum Int_op_index {
+  ioi_add,
+  ioi_sub,
+  ioi_mul,
+  ioi_div,
+  ioi_mod,
+  ioi_eq,
+  ioi_ne,
+  ioi_lt,
+  ioi_gt,
+  ioi_le,
+  ioi_ge,
+  ioi_none,
+};
+
+static const Int ioi_flag_ints = 1<<4; // set on ops whose operands are known to be Ints.
+
+
+static Int_op_index compile_int_op_index(Func_host_ptr ptr) {
+  if (ptr == host_iadd) return ioi_add;
+  if (ptr == host_isub) return ioi_sub;
+  if (ptr == host_imul) return ioi_mul;
+  if (ptr == host_idiv) return ioi_div;
+  if (ptr == host_imod) return ioi_mod;
+  if (ptr == host_ieq) return ioi_eq;
+  if (ptr == host_ine) return ioi_ne;
+  if (ptr == host_ilt) return ioi_lt;
+  if (ptr == host_igt) return ioi_gt;
+  if (ptr == host_ile) return ioi_le;
+  if (ptr == host_ige) return ioi_ge;
+  return ioi_none;
+}
+
+
+static Obj compile_int_op(Compiler& c, Obj call) {
+  // owns call, a compiled Call; returns either an Int-op node that wraps it, or call.
+  Obj exprs = call.cmpd_el(0);
+  Func_host_ptr ptr = compile_host_ptr(c, exprs);
+  if (!ptr || exprs.cmpd_len() != 3) return call;
+  Int_op_index op = compile_int_op_index(ptr);
+  if (op == ioi_none) return call;
+  Bool is_ints = true;
+  for_imn(i, 1, 3) {
+    Obj arg = exprs.cmpd_el(i);
+    Obj arg_type = arg.type();
+    if (arg_type == t_Label || arg_type == t_Splice) return call;
+    is_ints = is_ints && (arg.is_int() || (c.int_pars && c.int_pars->contains(arg)));
+  }
+  Int op_flags = op | (is_ints ? ioi_flag_ints : 0);
+  return track_src(call, Obj::Cmpd(t_Int_op.ret(), Obj::with_Int(op_flags), call));
+}
+
+
+// struct construction.
+// a CONS call whose type arg is a sym bound to a struct type in the compile env,
+// with one unlabeled or correctly labeled arg per field, is replaced by a Cons-struct node,
+// which run_Cons_struct evaluates by allocating the struct directly and filling in the args,
+// without assembling call vals or checking labels.
+// as with host functions, the type sym must not be bound anywhere within the compiled code.
+// the node retains the resolved Type and the original Call, which write_repr shows;
+// code walkers must not descend into the Type, which may be recursive.
+
+static Obj compile_cons_struct(Compiler& c, Obj call) {
+  // owns call, a compiled Call; returns either a Cons-struct node that wraps it, or call.
+  if (!c.can_fold) return call;
+  Obj exprs = call.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  if (len < 2 || exprs.cmpd_el(0) != s_CONS) return call;
+  Obj type_sym = exprs.cmpd_el(1);
+  if (!type_sym.is_sym() || type_sym.is_data_word() || type_sym.is_special_sym()) return call;
+  if (c.binds.contains(type_sym)) return call;
+  Obj type = env_get(c.env, type_sym);
+  if (!type.vld() || type.type() != t_Type || !is_kind_struct(type.cmpd_el(1))) return call;
+  Obj fields = kind_fields(type.cmpd_el(1));
+  if (len - 2 != fields.cmpd_len()) return call; // let run_call_CONS raise the error.
+  for_imn(i, 2, len) {
+    Obj arg = exprs.cmpd_el(i);
+    Obj arg_type = arg.type();
+    if (arg_type == t_Splice) return call;
+    if (arg_type == t_Label) {
+      if (arg.cmpd_len() != 3 || arg.cmpd_el(1) != s_nil) return call;
+      if (arg.cmpd_el(0) != fields.cmpd_el(i - 2).cmpd_el(0)) return call;
+    }
+  }
+  return track_src(call, Obj::Cmpd(t_Cons_struct.ret(), type.ret(), call));
+}
+
+
+static Obj compile_call_node(Compiler& c, Obj call) {
+  // owns call, a compiled Call; returns it, or a node that replaces it.
+  if (call.cmpd_el(0).cmpd_el(0) == s_CONS) return compile_cons_struct(c, call);
+  return compile_int_op(c, call);
+}
+
+
+// inlining of native functions.
+// a call is inlined when the callee sym resolves to a native Func with a small body,
+// and every free sym in that body resolves to the same binding at the call site,
+// so that running the body in the caller env is equivalent to running it in the lex env.
+// the body is restricted to Call, If, syms and constants, so it cannot bind anything.
+// args that are constants, Quos, or bound global syms are substituted for every use of the par;
+// any other arg must be used exactly once, before any call or branch in the body runs,
+// and in par order, so that args are still evaluated exactly once and in the same order.
+// the compiled body is wrapped in an Inlined node, which takes the source loc of the call,
+// while the body keeps the locs of the callee; run_Inlined runs the body as a tail step,
+// so that a trace through it shows the call site and then the body, as for the call.
+// the node also holds the Func and a copy of its fields; if the Func is mutated in place,
+// run_Inlined makes the original call instead, so that inlined calls observe the mutation.
+
+static const Int compile_inline_max_size = 16; // max body size, counted in nodes.
+static const Int compile_inline_max_depth = 4; // max nesting of inlined bodies.
+static const Int compile_inline_max_pars = 4;
+
+
+struct Inline_scan {
+  Obj env; // the lex env of the Func; borrowed.
+  Obj pars; // the Arr-Par of the Func; borrowed.
+  Obj* args; // the call args; borrowed.
+  Bool* is_trivial; // per par: the arg can be duplicated, dropped, or reordered.
+  Int* uses; // per par: the number of uses in the body.
+  Int len_args;
+  Int size;
+  Int next_nontrivial; // the index of the next par with a nontrivial arg, in par order.
+  Bool has_run_effect; // a call or branch has been scanned, in evaluation order.
+};
+
+
+static Bool compile_is_trivial_arg(Compiler& c, Obj arg) {
+  if (compile_is_const(arg)) return true;
+  if (arg.type() == t_Quo) return true;
+  return arg.is_sym() && !c.binds.contains(arg) && env_get(c.env, arg).vld();
+}
+
+
+static Int compile_inline_par_index(Obj pars, Obj sym) {
+  for_in(i, pars.cmpd_len()) {
+    if (pars.cmpd_el(i).cmpd_el(0) == sym) return i;
+  }
+  return -1;
+}
+
+
+static Bool compile_inline_scan(Compiler& c, Inline_scan& s, Obj code, Bool is_cond) {
+  // walk the body in evaluation order; returns false if the body cannot be inlined.
+  if (++s.size > compile_inline_max_size) return false;
+  if (compile_is_const(code)) return true;
+  if (code.is_sym()) {
+    if (code == s_self || code == s_RUN || code == s_EXPAND) return false;
+    Int i = compile_inline_par_index(s.pars, code);
+    if (i >= 0) {
+      s.uses[i]++;
+      if (s.is_trivial[i]) return true;
+      if (is_cond || s.has_run_effect || i != s.next_nontrivial) return false;
+      do { s.next_nontrivial++; }
+      while (s.next_nontrivial < s.len_args && s.is_trivial[s.next_nontrivial]);
+      return true;
+    }
+    // the free sym must resolve to the same binding at the call site.
+    if (c.binds.contains(code)) return false;
+    Obj val = env_get(s.env, code);
+    return val.vld() && val == env_get(c.env, code);
+  }
+  Obj type = code.type();
+  if (type == t_Quo) return true;
+  if (type == t_Int_op || type == t_Cons_struct) { // scan the wrapped Call in its place.
+    s.size--;
+    return compile_inline_scan(c, s, code.cmpd_el(1), is_cond);
+  }
+  if (type == t_Inlined) {
+    s.size--;
+    return compile_inline_scan(c, s, code.cmpd_el(0), is_cond);
+  }
+  if (type != t_Call && type != t_If) return false;
+  if (code.cmpd_len() != 1) return false;
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  if (type == t_If) {
+    if (len != 3) return false;
+    if (!compile_inline_scan(c, s, exprs.cmpd_el(0), is_cond)) return false;
+    s.has_run_effect = true;
+    return compile_inline_scan(c, s, exprs.cmpd_el(1), true)
+      && compile_inline_scan(c, s, exprs.cmpd_el(2), true);
+  }
+  if (!len) return false;
+  for_val(el, exprs.cmpd_it()) {
+    Obj el_type = el.type();
+    if (el_type == t_Label || el_type == t_Splice) return false;
+    if (!compile_inline_scan(c, s, el, is_cond)) return false;
+  }
+  s.has_run_effect = true;
+  return true;
+}
+
+
+static Obj compile_inline_subst(Obj code, Obj src, Obj pars, Obj* args) {
+  // borrows code; returns a copy of code with each par sym replaced by its arg.
+  // the copy inherits the source loc of src.
+  if (code.is_sym()) {
+    Int i = compile_inline_par_index(pars, code);
+    return (i >= 0) ? args[i].ret() : code.ret_val();
+  }
+  if (!code.is_cmpd() || code.ref_type() == t_Quo) return code.ret();
+  if (code.ref_type() == t_Int_op || code.ref_type() == t_Cons_struct) {
+    // substitute into the wrapped Call; recompiling the result wraps it again.
+    return compile_inline_subst(code.cmpd_el(1), src, pars, args);
+  }
+  if (code.ref_type() == t_Inlined) return compile_inline_subst(code.cmpd_el(0), src, pars, args);
+  Int len = code.cmpd_len();
+  Obj copy = Obj::Cmpd_raw(code.ref_type().ret(), len);
+  for_in(i, len) {
+    Obj el = code.cmpd_el(i);
+    copy.cmpd_put(i, compile_inline_subst(el, el, pars, args));
+  }
+  return track_src(src, copy);
+}
+
+
+static Obj compile_inline_body(Obj body) {
+  // borrows body; returns the single expression of the body, or obj0.
+  // let-fn prepends `let name self;` to the body;
+  // such lets can be skipped provided that the name is not referenced.
+  // any such reference is rejected by compile_inline_scan as an unbound free sym.
+  // a memoized body is never inlined, as calls must go through its cache.
+  if (body.type() == t_Memo) return obj0;
+  if (body.type() != t_Arr_Expr) return body;
+  Int len = body.cmpd_len();
+  if (!len) return obj0;
+  for_in(i, len - 1) {
+    Obj e = body.cmpd_el(i);
+    if (e.type() != t_Let || e.cmpd_len() != 1) return obj0;
+    Obj exprs = e.cmpd_el(0);
+    if (exprs.cmpd_len() != 2 || exprs.cmpd_el(1) != s_self) return obj0;
+  }
+  return body.cmpd_el(len - 1);
+}
+
+
+static Bool compile_cannot_raise(Compiler& c, Obj code) {
+  // borrows code, a compiled expression.
+  // true if running code cannot raise: it consists only of constants, Quos, bound syms,
+  // Ifs, and calls to host functions that accept any args.
+  if (compile_is_const(code)) return true;
+  if (code.is_sym()) {
+    if (code.is_data_word() || code.is_special_sym()) return false;
+    return c.binds.contains(code) || env_get(c.env, code).vld();
+  }
+  Obj type = code.type();
+  if (type == t_Quo) return true;
+  if ((type != t_Call && type != t_If) || code.cmpd_len() != 1) return false;
+  Obj exprs = code.cmpd_el(0);
+  if (type == t_If) {
+    if (exprs.cmpd_len() != 3) return false;
+  } else {
+    Func_host_ptr ptr = compile_host_ptr(c, exprs);
+    if (ptr != host_identity && ptr != host_is && ptr != host_is_ref && ptr != host_is_true
+      && ptr != host_not && ptr != host_id_hash && ptr != host_type_of) return false;
+  }
+  for_imn(i, (type == t_If) ? 0 : 1, exprs.cmpd_len()) {
+    if (!compile_cannot_raise(c, exprs.cmpd_el(i))) return false;
+  }
+  return true;
+}
+
+
+static Obj compile_inline_call(Compiler& c, Obj exprs, Obj* func) {
+  // borrows exprs, the compiled elements of a Call.
+  // returns the inlined body, and sets func to the callee; or returns obj0.
+  if (!c.can_fold || c.inline_depth >= compile_inline_max_depth) return obj0;
+  Obj callee = exprs.cmpd_el(0);
+  if (!callee.is_sym() || callee.is_data_word() || callee.is_special_sym()) return obj0;
+  if (c.binds.contains(callee)) return obj0;
+  Obj f = env_get(c.env, callee);
+  if (!f.vld() || f.type() != t_Func || f.cmpd_len() != 8) return obj0;
+  if (f.cmpd_el(0) != s_true || f.cmpd_el(1) != s_false || f.cmpd_el(3) != t_Obj
+    || f.cmpd_el(4) != s_void || f.cmpd_el(5) != s_void) return obj0;
+  Obj lex_env = f.cmpd_el(2);
+  Obj pars = f.cmpd_el(6);
+  if (!(lex_env == s_ENV_END || lex_env.is_env()) || pars.type() != t_Arr_Par) return obj0;
+  Int len_args = exprs.cmpd_len() - 1;
+  if (len_args != pars.cmpd_len() || len_args > compile_inline_max_pars) return obj0;
+  Obj* args = exprs.cmpd_els() + 1;
+  for_in(i, len_args) {
+    Obj par = pars.cmpd_el(i);
+    if (par.type() != t_Par || par.cmpd_el(1) != t_Obj || par.cmpd_el(2) != s_void) return obj0;
+    Obj arg_type = args[i].type();
+    if (arg_type == t_Label || arg_type == t_Splice) return obj0;
+  }
+  Obj body = compile_inline_body(f.cmpd_el(7));
+  if (!body.vld()) return obj0;
+  Bool is_trivial[compile_inline_max_pars];
+  Int uses[compile_inline_max_pars];
+  Inline_scan s = {lex_env, pars, args, is_trivial, uses, len_args, 0, len_args, false};
+  for_in(i, len_args) {
+    is_trivial[i] = compile_is_trivial_arg(c, args[i]);
+    uses[i] = 0;
+    if (!is_trivial[i] && s.next_nontrivial == len_args) s.next_nontrivial = i;
+  }
+  if (!compile_inline_scan(c, s, body, false)) return obj0;
+  for_in(i, len_args) {
+    if (!is_trivial[i] && uses[i] != 1) return obj0;
+  }
+  *func = f;
+  return compile_inline_subst(body, body, pars, args);
+}
+
+
+static Obj compile_inlined(Compiler& c, Obj call, Obj func, Obj body) {
+  // owns call, body; borrows func. returns the Inlined node that replaces call.
+  // a let-fn body is a sequence, which a call runs as one more tail step before the expression;
+  // the body is wrapped likewise, so that traces through the node elide as many steps.
+  // a body that cannot raise never appears in a trace, so it is left as is.
+  if (func.cmpd_el(7).type() == t_Arr_Expr && !compile_cannot_raise(c, body)) {
+    body = Obj::Cmpd(t_Arr_Expr.ret(), body);
+  }
+  Int len = func.cmpd_len();
+  Obj fields = Obj::Cmpd_raw(t_Arr_Obj.ret(), len);
+  for_in(i, len) {
+    fields.cmpd_put(i, func.cmpd_el(i).ret());
+  }
+  Obj node = Obj::Cmpd(t_Inlined.ret(), call, func.ret(), fields, body);
+  track_src(call, node);
+  return node;
+}
+
+static Obj compile_expr(Compiler& c, Obj code);
+
+
+static Obj compile_sub(Compiler& c, Obj el, Bool* changed) {
+  // borrows el; returns the compiled el, and sets changed if it is a different object.
+  Obj compiled = compile_expr(c, el.ret());
+  if (compiled != el) *changed = true;
+  return compiled;
+}
+
+
+static Obj compile_seq(Compiler& c, Obj code) {
+  // owns code, an Arr_Expr in expression position.
+  // nested non-empty sequences are spliced, since run_Arr_Expr threads env through both;
+  // constants are dropped unless they are in the last position.
+  Int len = code.cmpd_len();
+  if (len == 1 && code.cmpd_el(0).type() == t_Arr_Expr) {
+    // a sequence wrapping a single sequence, typically from a macro; keep the inner one,
+    // which usually carries the source loc.
+    Obj inner = compile_expr(c, code.cmpd_el(0).ret());
+    code.rel();
+    return inner;
+  }
+  Bool changed = false;
+  List els(len);
+  for_in(i, len) {
+    Obj e = compile_sub(c, code.cmpd_el(i), &changed);
+    if (e.type() == t_Arr_Expr && e.cmpd_len() > 0) {
+      for_val(sub, e.cmpd_it()) {
+        els.append(sub.ret());
+      }
+      e.rel();
+      changed = true;
+    } else if (i < len - 1 && compile_is_const(e)) {
+      e.rel();
+      changed = true;
+    } else {
+      els.append(e);
+    }
+  }
+  if (!changed) {
+    els.rel_els_dealloc();
+    return code;
+  }
+  Obj compiled = Obj::Cmpd_raw(t_Arr_Expr.ret(), els.len());
+  for_in(i, els.len()) {
+    compiled.cmpd_put(i, els.el_move(i));
+  }
+  els.dealloc();
+  track_src(code, compiled);
+  code.rel();
+  return compiled;
+}
+
+
+static Obj compile_call_arg(Compiler& c, Obj arg, Bool* changed) {
+  // borrows arg.
+  Obj type = arg.type();
+  Bool sub_changed = false;
+  Obj compiled;
+  if (type == t_Label && arg.cmpd_len() == 3) {
+    Obj expr = compile_sub(c, arg.cmpd_el(2), &sub_changed);
+    if (!sub_changed) {
+      expr.rel();
+      return arg.ret();
+    }
+    compiled = Obj::Cmpd(t_Label.ret(), arg.cmpd_el(0).ret(), arg.cmpd_el(1).ret(), expr);
+  } else if (type == t_Splice && arg.cmpd_len() == 1) {
+    Obj expr = compile_sub(c, arg.cmpd_el(0), &sub_changed);
+    if (!sub_changed) {
+      expr.rel();
+      return arg.ret();
+    }
+    compiled = Obj::Cmpd(t_Splice.ret(), expr);
+  } else {
+    return compile_sub(c, arg, changed);
+  }
+  *changed = true;
+  return track_src(arg, compiled);
+}
+
+
+static Obj compile_Call(Compiler& c, Obj code) {
+  // owns code.
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  if (!len) return code; // let run_Call raise the error.
+  Bool changed = false;
+  Obj compiled_exprs = Obj::Cmpd_raw(t_Arr_Expr.ret(), len);
+  compiled_exprs.cmpd_put(0, compile_sub(c, exprs.cmpd_el(0), &changed));
+  for_imn(i, 1, len) {
+    compiled_exprs.cmpd_put(i, compile_call_arg(c, exprs.cmpd_el(i), &changed));
+  }
+  Obj folded = compile_fold_call(c, compiled_exprs);
+  if (folded.vld()) {
+    compiled_exprs.rel();
+    code.rel();
+    return folded;
+  }
+  Obj func = obj0;
+  Obj inlined = compile_inline_call(c, compiled_exprs, &func);
+  Obj call;
+  if (!changed) {
+    compiled_exprs.rel();
+    call = code;
+  } else {
+    track_src(exprs, compiled_exprs);
+    call = track_src(code, Obj::Cmpd(t_Call.ret(), compiled_exprs));
+    code.rel();
+  }
+  if (inlined.vld()) {
+    c.inline_depth++;
+    Obj body = compile_expr(c, inlined); // fold the substituted args into the body.
+    c.inline_depth--;
+    return compile_inlined(c, call, func, body);
+  }
+  return compile_call_node(c, call);
+}
+
+
+static Obj compile_If(Compiler& c, Obj code) {
+  // owns code.
+  Obj exprs = code.cmpd_el(0);
+  if (exprs.cmpd_len() != 3) return code; // let run_If raise the error.
+  Bool changed = false;
+  Obj pred = compile_sub(c, exprs.cmpd_el(0), &changed);
+  if (compile_is_const(pred)) { // dead branch; compile only the live one.
+    Obj branch = exprs.cmpd_el(pred.is_true() ? 1 : 2).ret();
+    pred.rel();
+    code.rel();
+    return compile_expr(c, branch);
+  }
+  Obj then = compile_sub(c, exprs.cmpd_el(1), &changed);
+  Obj else_ = compile_sub(c, exprs.cmpd_el(2), &changed);
+  if (!changed) {
+    pred.rel();
+    then.rel();
+    else_.rel();
+    return code;
+  }
+  Obj compiled_exprs = track_src(exprs, Obj::Cmpd(t_Arr_Expr.ret(), pred, then, else_));
+  Obj compiled = track_src(code, Obj::Cmpd(t_If.ret(), compiled_exprs));
+  code.rel();
+  return compiled;
+}
+
+
+static Obj compile_Let(Compiler& c, Obj code) {
+  // owns code.
+  Obj exprs = code.cmpd_el(0);
+  if (exprs.cmpd_len() != 2) return code; // let run_Let raise the error.
+  Bool changed = false;
+  Obj expr = compile_sub(c, exprs.cmpd_el(1), &changed);
+  if (!changed) {
+    expr.rel();
+    return code;
+  }
+  Obj compiled_exprs = track_src(exprs,
+    Obj::Cmpd(t_Arr_Expr.ret(), exprs.cmpd_el(0).ret(), expr));
+  Obj compiled = track_src(code, Obj::Cmpd(t_Let.ret(), compiled_exprs));
+  code.rel();
+  return compiled;
+}
+
+
+// native loops.
+// the loop syms are bound in a new frame around the body, where they can shadow the enclosing
+// Int pars, as can any Let in the body; so the body is compiled with the enclosing Int pars
+// less all of those syms, plus the sym of a Loop, which is always bound to an Int.
+
+static Obj compile_loop(Compiler& c, Obj code) {
+  // owns code, a Loop or Each.
+  Obj exprs = code.cmpd_el(0);
+  Bool is_range = (code.ref_type() == t_Loop);
+  Int len = exprs.cmpd_len();
+  if (len != (is_range ? 6 : 5)) return code; // let run_Loop or run_Each raise the error.
+  Obj sym = exprs.cmpd_el(0);
+  Obj acc_sym = exprs.cmpd_el(len - 3);
+  Obj body = exprs.cmpd_el(len - 1);
+  Bool changed = false;
+  Obj compiled_exprs = Obj::Cmpd_raw(t_Arr_Expr.ret(), len);
+  for_in(i, len - 1) { // the syms compile to themselves.
+    compiled_exprs.cmpd_put(i, compile_sub(c, exprs.cmpd_el(i), &changed));
+  }
+  Compiler body_scan(c.env);
+  compile_scan_binds(body_scan, body);
+  List body_int_pars;
+  if (c.int_pars) {
+    for_in(i, c.int_pars->len()) {
+      Obj par = c.int_pars->el(i);
+      if (par != sym && par != acc_sym && !body_scan.binds.contains(par)) {
+        body_int_pars.append(par.ret_val());
+      }
+    }
+  }
+  if (is_range && c.can_fold && sym.is_sym() && !body_scan.binds.contains(sym)) {
+    body_int_pars.append(sym.ret_val());
+  }
+  List* enclosing_int_pars = c.int_pars;
+  c.int_pars = &body_int_pars;
+  Obj compiled_body = compile_sub(c, body, &changed);
+  if (compiled_body.type() == t_Arr_Expr && compiled_body.cmpd_len() == 1) {
+    // the body runs once per iteration; skip the step through the single element sequence.
+    Obj el = compiled_body.cmpd_el(0).ret();
+    compiled_body.rel();
+    compiled_body = el;
+    changed = true;
+  }
+  compiled_exprs.cmpd_put(len - 1, compiled_body);
+  c.int_pars = enclosing_int_pars;
+  body_int_pars.rel_els_dealloc();
+  body_scan.binds.rel_els_dealloc();
+  if (!changed) {
+    compiled_exprs.rel();
+    return code;
+  }
+  track_src(exprs, compiled_exprs);
+  Obj compiled = track_src(code, Obj::Cmpd(code.ref_type().ret(), compiled_exprs));
+  code.rel();
+  return compiled;
+}
+
+
+static Obj compile_case_pat(Compiler& c, Obj pat, Bool* changed) {
+  // borrows pat; returns it, or a copy in which the type syms are replaced by their Types.
+  // a sym that the code might bind is left as is, as is any other pattern;
+  // run_Case resolves those, and raises any errors.
+  if (!c.can_fold) return pat.ret();
+  if (pat.is_sym()) {
+    if (pat.is_data_word() || pat.is_special_sym() || c.binds.contains(pat)) return pat.ret();
+    Obj type = env_get(c.env, pat);
+    if (!type.vld() || type.type() != t_Type) return pat.ret();
+    *changed = true;
+    return type.ret();
+  }
+  if (pat.type() != t_Call || pat.cmpd_len() != 1 || !pat.cmpd_el(0).cmpd_len()) {
+    return pat.ret();
+  }
+  Obj exprs = pat.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  Bool pat_changed = false;
+  Obj compiled_exprs = Obj::Cmpd_raw(t_Arr_Expr.ret(), len);
+  for_in(i, len) {
+    compiled_exprs.cmpd_put(i, compile_case_pat(c, exprs.cmpd_el(i), &pat_changed));
+  }
+  if (!pat_changed) {
+    compiled_exprs.rel();
+    return pat.ret();
+  }
+  *changed = true;
+  track_src(exprs, compiled_exprs);
+  return track_src(pat, Obj::Cmpd(t_Call.ret(), compiled_exprs));
+}
+
+
+static Obj compile_Case(Compiler& c, Obj code) {
+  // owns code.
+  // pattern syms that are bound in the env and cannot be rebound are replaced by their Types;
+  // run_Case resolves the rest each time it checks its case table.
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  if (!len) return code; // let run_Case raise the error.
+  Bool changed = false;
+  Obj compiled_exprs = Obj::Cmpd_raw(t_Arr_Expr.ret(), len);
+  for_in(i, len) {
+    Obj e = exprs.cmpd_el(i);
+    Bool is_pat = (i % 2 == 1 && i < len - 1);
+    compiled_exprs.cmpd_put(i,
+      is_pat ? compile_case_pat(c, e, &changed) : compile_sub(c, e, &changed));
+  }
+  if (!changed) {
+    compiled_exprs.rel();
+    return code;
+  }
+  track_src(exprs, compiled_exprs);
+  Obj compiled = track_src(code, Obj::Cmpd(t_Case.ret(), compiled_exprs));
+  code.rel();
+  return compiled;
+}
+
+
+static Obj compile_exprs(Compiler& c, Obj code) {
+  // owns code, a Values or Let-vals; compiles each of its exprs.
+  // the syms of Let-vals compile to themselves.
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  Bool changed = false;
+  Obj compiled_exprs = Obj::Cmpd_raw(t_Arr_Expr.ret(), len);
+  for_in(i, len) {
+    compiled_exprs.cmpd_put(i, compile_sub(c, exprs.cmpd_el(i), &changed));
+  }
+  if (!changed) {
+    compiled_exprs.rel();
+    return code;
+  }
+  track_src(exprs, compiled_exprs);
+  Obj compiled = track_src(code, Obj::Cmpd(code.ref_type().ret(), compiled_exprs));
+  code.rel();
+  return compiled;
+}
+
+
+static Obj compile_Pub(Compiler& c, Obj code) {
+  // owns code.
+  Bool changed = false;
+  Obj sub = compile_sub(c, code.cmpd_el(0), &changed);
+  if (!changed) {
+    sub.rel();
+    return code;
+  }
+  Obj compiled = track_src(code, Obj::Cmpd(t_Pub.ret(), sub));
+  code.rel();
+  return compiled;
+}
+
+
+// closure conversion.
+// for each compiled Fn, compile records every sym that appears in it, outside of Quo,
+// including the par type and default exprs and any nested Fn.
+// when the Fn runs, run_capture_env copies just the bindings of those syms into a compact env,
+// instead of retaining the entire env chain;
+// since bindings are immutable, the copies are indistinguishable from the originals.
+// nested Fns capture from the env of the enclosing call, so their syms are included.
+// the set is an over-approximation of the free syms: a sym bound locally is also captured if
+// an outer binding exists, which is harmless, since local bindings are made in a new frame.
+// Fns that refer to RUN or EXPAND may evaluate arbitrary code in their env, so are not recorded.
+// the Arr-Sym is kept in the hidden word of the Fn node (see Cmpd_raw), and released with it.
+
+static Obj* compile_fn_syms_slot(Obj fn) {
+  assert(fn.ref_type() == t_Fn);
+  return reinterpret_cast<Obj*>(fn.cmpd_els_unchecked() + fn.cmpd_len());
+}
+
+
+static void compile_fn_syms_release(Obj o) {
+  // release the recorded syms of Fn o, if any.
+  Obj* slot = compile_fn_syms_slot(o);
+  if (!slot->vld()) return;
+  slot->rel();
+  *slot = obj0;
+}
+
+
+static Bool compile_collect_syms(Obj code, List& syms) {
+  // returns false if code refers to RUN or EXPAND.
+  if (code.is_sym()) {
+    if (code == s_RUN || code == s_EXPAND) return false;
+    if (!code.is_data_word() && !code.is_special_sym() && !syms.contains(code)) {
+      syms.append(code.ret_val());
+    }
+    return true;
+  }
+  if (!code.is_cmpd() || code.ref_type() == t_Quo) return true;
+  if (code.ref_type() == t_Cons_struct) return compile_collect_syms(code.cmpd_el(1), syms);
+  if (code.ref_type() == t_Inlined) { // the body and, should the Func change, the call.
+    return compile_collect_syms(code.cmpd_el(0), syms)
+      && compile_collect_syms(code.cmpd_el(3), syms);
+  }
+  for_val(el, code.cmpd_it()) {
+    if (!compile_collect_syms(el, syms)) return false;
+  }
+  return true;
+}
+
+
+static void compile_record_fn_syms(Obj fn) {
+  // borrows fn.
+  Obj* slot = compile_fn_syms_slot(fn);
+  if (slot->vld()) return;
+  List syms;
+  if (compile_collect_syms(fn, syms)) {
+    Obj arr = Obj::Cmpd_raw(t_Arr_Sym.ret(), syms.len());
+    for_in(i, syms.len()) {
+      arr.cmpd_put(i, syms.el_move(i));
+    }
+    *slot = arr;
+    syms.dealloc();
+  } else {
+    syms.rel_els_dealloc();
+  }
+}
+
+
+static void compile_fn_int_pars(Compiler& c, Obj code, List& int_pars) {
+  // borrows code, a Fn; collects the names of its pars whose type expr resolves to Int.
+  // the types of macro pars are not checked at binding, so they are excluded.
+  if (!c.can_fold || code.cmpd_el(0) != s_true || code.cmpd_el(1) != s_false) return;
+  Obj pars_seq = code.cmpd_el(2);
+  if (pars_seq.type() != t_Syn_seq || pars_seq.cmpd_len() != 1) return;
+  for_val(syn, pars_seq.cmpd_el(0).cmpd_it()) {
+    if (syn.type() != t_Label || syn.cmpd_len() != 3) continue;
+    Obj name = syn.cmpd_el(0);
+    Obj type_expr = syn.cmpd_el(1);
+    if (!name.is_sym() || !type_expr.is_sym() || type_expr.is_special_sym()
+      || type_expr.is_data_word() || c.binds.contains(type_expr)) continue;
+    if (env_get(c.env, type_expr) == t_Int) int_pars.append(name.ret_val());
+  }
+}
+
+
+static Obj compile_Fn(Compiler& c, Obj code) {
+  // owns code.
+  // the pars are left as is; their type and default exprs are run by run_Fn and bind_par.
+  // a nested Fn runs in a new frame, where the enclosing pars can be shadowed.
+  if (code.cmpd_len() != 4) return code; // let run_Fn raise the error.
+  Bool changed = false;
+  List int_pars;
+  compile_fn_int_pars(c, code, int_pars);
+  List* enclosing_int_pars = c.int_pars;
+  c.int_pars = &int_pars;
+  Obj body = compile_sub(c, code.cmpd_el(3), &changed);
+  c.int_pars = enclosing_int_pars;
+  int_pars.rel_els_dealloc();
+  Obj compiled;
+  if (changed) {
+    compiled = track_src(code, Obj::Cmpd(t_Fn.ret(),
+      code.cmpd_el(0).ret(), code.cmpd_el(1).ret(), code.cmpd_el(2).ret(), body));
+    code.rel();
+  } else {
+    body.rel();
+    compiled = code;
+  }
+  compile_record_fn_syms(compiled);
+  return compiled;
+}
+
+
+static Obj compile_expr(Compiler& c, Obj code) {
+  // owns code.
+  if (!code.is_cmpd()) return code;
+  Obj type = code.ref_type();
+  if (type == t_Arr_Expr) return compile_seq(c, code);
+  if ((type == t_Int_op || type == t_Cons_struct) && code.cmpd_len() == 2) {
+    // code that is compiled again; unwrap the Call, since it may now fold.
+    Obj call = code.cmpd_el(1).ret();
+    code.rel();
+    return compile_expr(c, call);
+  }
+  if (type == t_Inlined && code.cmpd_len() == 4) { // likewise; the Func may have changed.
+    Obj call = code.cmpd_el(0).ret();
+    code.rel();
+    return compile_expr(c, call);
+  }
+  if (code.cmpd_len() != 1 && type != t_Fn) return code; // malformed; let run raise the error.
+  if (type == t_Call) return compile_Call(c, code);
+  if (type == t_If)   return compile_If(c, code);
+  if (type == t_Let)  return compile_Let(c, code);
+  if (type == t_Loop || type == t_Each) return compile_loop(c, code);
+  if (type == t_Case) return compile_Case(c, code);
+  if (type == t_Values || type == t_Let_vals) return compile_exprs(c, code);
+  if (type == t_Pub)  return compile_Pub(c, code);
+  if (type == t_Fn)   return compile_Fn(c, code);
+  return code; // Quo, or not runnable.
+}
+
+
+static Bool compile_may_read_sym(Obj code, Obj sym) {
+  // true if running code might look up sym: it appears outside of Quo,
+  // or RUN or EXPAND appear, which could look up any sym.
+  // used by func_decode to select variad and assoc pars that need not be materialized.
+  if (code.is_sym()) return code == sym || code == s_RUN || code == s_EXPAND;
+  if (!code.is_cmpd()) return false;
+  Obj type = code.ref_type();
+  if (type == t_Quo) return false;
+  if (type == t_Cons_struct) return compile_may_read_sym(code.cmpd_el(1), sym);
+  if (type == t_Inlined) {
+    return compile_may_read_sym(code.cmpd_el(0), sym) || compile_may_read_sym(code.cmpd_el(3), sym);
+  }
+  for_val(el, code.cmpd_it()) {
+    if (compile_may_read_sym(el, sym)) return true;
+  }
+  return false;
+}
+
+
+static Obj compile(Obj env, Obj code) {
+  // owns code.
+  Compiler c(env);
+  compile_scan_binds(c, code);
+  Obj compiled = compile_expr(c, code);
+  c.binds.rel_els_dealloc();
+  return compiled;
+}
+
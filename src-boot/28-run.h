@@ -0,0 +1,2611 @@
+ // Copyright 2013 George King.
+// Permission to use this file is granted in ploy/license.txt.
+
+#include "27-compile.h"
+
+
+// struct representing the result of a step of computation.
+struct Res {
+  Obj env; // the env to be passed to the next step.
+  Obj val; // the result from the step just performed.
+  Obj empty; // padding; must be obj0 for polymorph test.
+  Int len_extra; // the number of additional values held in run_vals; see run_Values.
+  Res(Obj e, Obj v): env(e), val(v), empty(obj0), len_extra(0) {}
+};
+
+struct Tail {
+  Obj env; // the caller env; this struct slot must match that of Res.
+  Obj callee_env; // the callee_env, to be used for the next tail step.
+  Obj code; // code for the TCO step.
+  Tail(Obj e, Obj ce, Obj c): env(e), callee_env(ce), code(c) {}
+};
+
+union Step {
+  Res res;
+  Tail tail;
+  Step(Obj e, Obj v): res(e, v) {}
+  Step(Obj e, Obj ce, Obj c): tail(e, ce, c) {}
+};
+
+
+#define is_step_res(step) !step.res.empty.vld()
+
+
+static Step run_sym(Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.is_sym());
+  if (code.u <= s_END_SPECIAL_SYMS.u) {
+    return Step(env, code.ret_val()); // special syms are self-evaluating.
+  }
+  Obj val = env_get(env, code);
+  exc_check(val.vld(), "lookup error: %o", code); // lookup failed.
+  return Step(env, val.ret());
+}
+
+
+static Step run_Quo(UNUSED Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  exc_check(code.cmpd_len() == 1, "Quo requires 1 field; received %i", code.cmpd_len());
+  return Step(env, code.cmpd_el(0).ret());
+}
+
+
+static Step run(Int depth, Trace* parent_trace, Obj env, Obj code);
+
+static Step run_Arr_Expr(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  Int len = code.cmpd_len();
+  if (!len) {
+    return Step(env, s_void.ret_val());
+  }
+  Int last = len - 1;
+  for_in(i, last) {
+    Step step = run(d, t, env, code.cmpd_el(i));
+    env = step.res.env;
+    step.res.val.rel(); // value ignored.
+  };
+  return Step(env, env, code.cmpd_el(last));
+}
+
+
+static Obj bind_val(Trace* t, Obj env, Bool is_public, Obj key, Obj val) {
+  // owns env, key, val.
+  Obj env1 = env_bind(env, is_public, key, val);
+  exc_check(env1.vld(), "symbol is already bound: %o", key);
+  return env1;
+}
+
+
+static Step run_Pub(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj sub = code.cmpd_el(0);
+  Step step = run(d, t, env, sub);
+  // TODO: export.
+  return step;
+}
+
+
+static Step run_Let(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  exc_check(exprs.cmpd_len() == 2, "Let requires 2 fields; received %i", code.cmpd_len());
+  Obj sym = exprs.cmpd_el(0);
+  Obj expr = exprs.cmpd_el(1);
+  exc_check(sym.is_sym(), "Let requires argument 1 to be a bindable sym; received: %o", sym);
+  exc_check(!sym.is_special_sym(), "Let cannot bind to special sym: %o", sym);
+  Step step = run(d, t, env, expr);
+  Obj env1 = bind_val(t, step.res.env, false, sym.ret_val(), step.res.val.ret());
+  return Step(env1, step.res.val);
+}
+
+
+// multiple values.
+// Values returns its first value as the val of its step, and holds the rest in run_vals,
+// recording their count in res.len_extra, so that returning several values allocates nothing.
+// the count passes unchanged through tail steps, and so through TCO returns from Func bodies;
+// any other step that uses the val starts a new Res, which drops the count.
+// Let-vals binds each value to a sym, moving the extra values out of run_vals.
+// values that are dropped stay in run_vals until the next Values replaces them.
+
+static const Int run_vals_max = 8; // including the first value.
+static Obj run_vals[run_vals_max - 1];
+static Int run_vals_len;
+
+
+static void run_vals_clear() {
+  for_in(i, run_vals_len) {
+    run_vals[i].rel();
+  }
+  run_vals_len = 0;
+}
+
+
+#if OPTION_ALLOC_COUNT
+static void run_vals_cleanup() {
+  run_vals_clear();
+}
+#endif
+
+
+static Step run_Values(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  exc_check(len > 0 && len <= run_vals_max, "Values requires 1 to %i exprs; received %i",
+    run_vals_max, len);
+  // the exprs may themselves return multiple values; hold all of them before filling run_vals.
+  Obj vals[run_vals_max];
+  for_in(i, len) {
+    Step step = run(d, t, env, exprs.cmpd_el(i));
+    env = step.res.env;
+    vals[i] = step.res.val;
+  }
+  run_vals_clear();
+  for_imn(i, 1, len) {
+    run_vals[i - 1] = vals[i];
+  }
+  run_vals_len = len - 1;
+  Step step(env, vals[0]);
+  step.res.len_extra = len - 1;
+  return step;
+}
+
+
+static Step run_Let_vals(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  Int len_syms = exprs.cmpd_len() - 1;
+  exc_check(len_syms > 0, "Let-vals requires at least 2 fields; received %i", len_syms + 1);
+  for_in(i, len_syms) {
+    Obj sym = exprs.cmpd_el(i);
+    exc_check(sym.is_sym() && !sym.is_special_sym(),
+      "Let-vals requires argument %i to be a bindable sym; received: %o", i + 1, sym);
+  }
+  Obj expr = exprs.cmpd_el(len_syms);
+  Step step = run(d, t, env, expr);
+  Int len_vals = step.res.len_extra + 1;
+  exc_check(len_vals == len_syms, "Let-vals binds %i syms but received %i values from: %o",
+    len_syms, len_vals, expr);
+  Obj val = step.res.val;
+  env = bind_val(t, step.res.env, false, exprs.cmpd_el(0).ret_val(), val.ret());
+  if (len_syms > 1) {
+    assert(step.res.len_extra == run_vals_len);
+    for_imn(i, 1, len_syms) {
+      env = bind_val(t, env, false, exprs.cmpd_el(i).ret_val(), run_vals[i - 1]);
+    }
+    run_vals_len = 0; // moved into env.
+  }
+  return Step(env, val);
+}
+
+
+static Step run_If(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  exc_check(exprs.cmpd_len() == 3, "If requires 3 fields; received %i", exprs.cmpd_len());
+  Obj pred = exprs.cmpd_el(0);
+  Obj then = exprs.cmpd_el(1);
+  Obj else_ = exprs.cmpd_el(2);
+  Step step = run(d, t, env, pred);
+  env = step.res.env;
+  Obj branch = step.res.val.is_true() ? then : else_;
+  step.res.val.rel();
+  return Step(env, env, branch);
+}
+
+
+// native loops.
+// Loop binds its sym to each Int from start up to but excluding end;
+// Each binds its sym to each element of an Arr.
+// both also bind an accumulator sym, first to the value of init, and then to the value of the body
+// from the previous iteration; the value of the loop is the final value of the accumulator.
+// the two bindings form a single frame, which persists across iterations:
+// if the body has not captured the frame, then both bindings are updated in place,
+// so that an iteration allocates nothing; otherwise a new frame replaces it.
+
+static void run_loop_check_syms(Trace* t, Chars form, Obj sym, Obj acc_sym) {
+  exc_check(sym.is_sym() && !sym.is_special_sym(),
+    "%s requires argument 1 to be a bindable sym; received: %o", form, sym);
+  exc_check(acc_sym.is_sym() && !acc_sym.is_special_sym(),
+    "%s requires an accumulator that is a bindable sym; received: %o", form, acc_sym);
+  exc_check(sym != acc_sym, "%s binds the same sym twice: %o", form, sym);
+}
+
+
+static Obj run_loop_frame(Obj env, Obj sym, Obj val, Obj acc_sym, Obj acc) {
+  // borrows env, sym, acc_sym; owns val, acc.
+  Obj frame = env_push_frame(env.ret());
+  frame = env_new(false, acc_sym.ret_val(), acc, frame);
+  return env_new(false, sym.ret_val(), val, frame);
+}
+
+
+static Obj run_loop_rebind(Obj env, Obj frame, Obj sym, Obj val, Obj acc_sym, Obj acc) {
+  // owns frame, val, acc; returns the frame for the next iteration.
+  Obj acc_node = frame.e->tl;
+  if (frame.is_unique() && acc_node.is_unique()) {
+    frame.e->val.rel();
+    frame.e->val = val;
+    acc_node.e->val.rel();
+    acc_node.e->val = acc;
+    return frame;
+  }
+  frame.rel(); // the body captured the frame.
+  return run_loop_frame(env, sym, val, acc_sym, acc);
+}
+
+
+static Step run_Loop(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  exc_check(exprs.cmpd_len() == 6, "Loop requires 6 fields; received %i", exprs.cmpd_len());
+  Obj sym = exprs.cmpd_el(0);
+  Obj acc_sym = exprs.cmpd_el(3);
+  Obj body = exprs.cmpd_el(5);
+  run_loop_check_syms(t, "Loop", sym, acc_sym);
+  Step step = run(d, t, env, exprs.cmpd_el(1));
+  Obj start = step.res.val;
+  exc_check(start.is_int(), "Loop requires start to be an Int; received: %o", start);
+  step = run(d, t, step.res.env, exprs.cmpd_el(2));
+  Obj end = step.res.val;
+  exc_check(end.is_int(), "Loop requires end to be an Int; received: %o", end);
+  step = run(d, t, step.res.env, exprs.cmpd_el(4));
+  env = step.res.env;
+  Obj acc = step.res.val;
+  Int i = start.int_val();
+  Int e = end.int_val();
+  start.rel_val();
+  end.rel_val();
+  if (i >= e) return Step(env, acc);
+  Obj frame = run_loop_frame(env, sym, Obj::with_Int(i), acc_sym, acc);
+  loop {
+    step = run(d, t, frame.ret(), body);
+    step.res.env.rel(); // release any bindings made by the body.
+    if (++i == e) break;
+    frame = run_loop_rebind(env, frame, sym, Obj::with_Int(i), acc_sym, step.res.val);
+  }
+  frame.rel();
+  return Step(env, step.res.val);
+}
+
+
+static Step run_Each(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  exc_check(exprs.cmpd_len() == 5, "Each requires 5 fields; received %i", exprs.cmpd_len());
+  Obj sym = exprs.cmpd_el(0);
+  Obj acc_sym = exprs.cmpd_el(2);
+  Obj body = exprs.cmpd_el(4);
+  run_loop_check_syms(t, "Each", sym, acc_sym);
+  Step step = run(d, t, env, exprs.cmpd_el(1));
+  Obj arr = step.res.val;
+  exc_check(arr.is_cmpd() && is_kind_arr(type_kind(arr.type())),
+    "Each requires argument 2 to be an Arr; received: %o", arr);
+  step = run(d, t, step.res.env, exprs.cmpd_el(3));
+  env = step.res.env;
+  Obj acc = step.res.val;
+  Int len = arr.cmpd_len();
+  if (!len) {
+    arr.rel();
+    return Step(env, acc);
+  }
+  Obj frame = run_loop_frame(env, sym, arr.cmpd_el(0).ret(), acc_sym, acc);
+  for_imn(i, 1, len + 1) {
+    step = run(d, t, frame.ret(), body);
+    step.res.env.rel(); // release any bindings made by the body.
+    if (i == len) break;
+    frame = run_loop_rebind(env, frame, sym, arr.cmpd_el(i).ret(), acc_sym, step.res.val);
+  }
+  frame.rel();
+  arr.rel();
+  return Step(env, step.res.val);
+}
+
+
+// multiway branch.
+// Case runs the branch of the first pattern that matches the value of its subject;
+// if none matches, it runs the default branch, or returns void if there is none.
+// its exprs are the subject, then pattern and branch pairs, then the optional default.
+// patterns are not evaluated; each is one of:
+// an Int, a special sym, or a quoted Int or Sym, which matches the identical value;
+// a sym bound to a Type, which matches values that conform to it (Obj matches any value);
+// or a call of a struct type on one sub-pattern per field, which matches instances of the type
+// whose fields match.
+// compile_Case replaces the pattern syms that cannot be rebound by their Types;
+// on its first run, a Case resolves the remaining syms in the current env and builds a Case_table,
+// which is cached in the hidden word of the node (see Cmpd_raw), and freed with it.
+// the table records the bindings of those syms; when a later run sees a different binding,
+// e.g. of a par, the table is rebuilt.
+// Int keys that lie in a dense range index a jump table; the other Int and Sym keys are hashed.
+// type and struct patterns of exact types are grouped by type in a second hash table,
+// so that the subject's type selects the few patterns that can match, which are tested in order;
+// patterns of other types (Obj, unions) are tested in order for every subject.
+// thus a match costs a constant number of lookups, plus the tests of the selected patterns.
+
+struct Case_table {
+  Obj pats; // Arr-Obj of the resolved pattern of each alternative.
+  Int len_alts;
+  Int jump_min; // the Int key of jump[0].
+  Int jump_len;
+  Int* jump; // for each Int key in range, the index of its first alternative plus 1; or 0.
+  Dict vals; // Int keys if there is no jump table, and Sym keys; maps to the alternative index.
+  Dict types; // maps each exact Type to an Arr-Int of the alternatives that require it.
+  Obj generic; // Arr-Int of the alternatives that require other types; or obj0.
+  Obj deps; // Arr-Obj of pairs of pattern sym and the Type it resolved to at run time; or obj0.
+};
+DEF_SIZE(Case_table);
+
+static const Int case_jump_min_keys = 4;
+static const Int case_jump_max_len = 1<<12;
+
+
+static Case_table** case_table_slot(Obj o) {
+  assert(o.ref_type() == t_Case);
+  return reinterpret_cast<Case_table**>(o.cmpd_els_unchecked() + o.cmpd_len());
+}
+
+
+static void case_table_release(Obj o) {
+  // free the table of Case o, if any.
+  Case_table** slot = case_table_slot(o);
+  Case_table* ct = *slot;
+  if (!ct) return;
+  *slot = null;
+  ct->pats.rel();
+  ct->vals.rel_els_dealloc();
+  ct->types.rel_els_dealloc();
+  if (ct->generic.vld()) ct->generic.rel();
+  if (ct->deps.vld()) ct->deps.rel();
+  raw_dealloc(ct->jump, ci_Case_table);
+  raw_dealloc(ct, ci_Case_table);
+}
+
+
+static Bool case_type_is_exact(Obj type) {
+  // true if every value that conforms to type has exactly that type.
+  Obj kind = type_kind(type);
+  return is_kind_struct(kind) || is_kind_arr(kind) || is_kind_unit(kind)
+    || kind.type() == t_Type_kind_prim;
+}
+
+
+static Obj case_pat_type(Obj pat) {
+  // returns the type required by a type or struct pattern.
+  return (pat.ref_type() == t_Type) ? pat : pat.cmpd_el(0);
+}
+
+
+static Obj case_resolve_pat(Trace* t, Obj env, Obj code, Obj pat, List& deps) {
+  // returns the resolved form of pat: an Int or Sym value, a Type,
+  // or an Arr-Obj of a struct type followed by the resolved sub-patterns.
+  // each sym resolved in env is appended to deps, followed by its Type.
+  if (pat.is_int()) return pat.ret_val();
+  if (pat.is_sym() && !pat.is_data_word()) {
+    if (pat.is_special_sym()) return pat.ret_val();
+    Obj type = env_get(env, pat);
+    exc_check(type.vld() && type.type() == t_Type,
+      "case: %o\npattern sym is not bound to a Type: %o", code, pat);
+    deps.append(pat.ret_val());
+    deps.append(type.ret());
+    return type.ret();
+  }
+  Obj pat_type = pat.type();
+  if (pat_type == t_Type) return pat.ret(); // resolved by compile_Case.
+  if (pat_type == t_Quo && pat.cmpd_len() == 1) {
+    Obj val = pat.cmpd_el(0);
+    exc_check((val.is_int() || val.is_sym()) && !val.is_data_word(),
+      "case: %o\nquoted pattern is not an Int or Sym: %o", code, val);
+    return val.ret_val();
+  }
+  if (pat_type == t_Call && pat.cmpd_len() == 1 && pat.cmpd_el(0).cmpd_len() > 0) {
+    Obj exprs = pat.cmpd_el(0);
+    Int len = exprs.cmpd_len();
+    Obj head = exprs.cmpd_el(0);
+    Obj type = head;
+    if (head.is_sym()) {
+      type = head.is_special_sym() ? obj0 : env_get(env, head);
+      if (type.vld()) {
+        deps.append(head.ret_val());
+        deps.append(type.ret());
+      }
+    }
+    exc_check(type.vld() && type.type() == t_Type && is_kind_struct(type_kind(type)),
+      "case: %o\nstruct pattern does not name a struct type: %o", code, pat);
+    Int len_fields = kind_fields(type_kind(type)).cmpd_len();
+    exc_check(len - 1 == len_fields,
+      "case: %o\nstruct pattern for %o expects %i fields; received %i",
+      code, type_name(type), len_fields, len - 1);
+    Obj res = Obj::Cmpd_raw(t_Arr_Obj.ret(), len);
+    res.cmpd_put(0, type.ret());
+    for_imn(i, 1, len) {
+      res.cmpd_put(i, case_resolve_pat(t, env, code, exprs.cmpd_el(i), deps));
+    }
+    return res;
+  }
+  exc_raise("case: %o\nunsupported pattern: %o", code, pat);
+}
+
+
+static Obj case_alts_of_type(Obj pats, Obj type, Bool is_exact) {
+  // returns an Arr-Int of the alternatives whose pattern requires type;
+  // or, if is_exact is false, of those whose pattern requires any type that is not exact.
+  // returns obj0 if there are none.
+  List alts;
+  for_in(i, pats.cmpd_len()) {
+    Obj pat = pats.cmpd_el(i);
+    if (!pat.is_ref()) continue;
+    Obj pt = case_pat_type(pat);
+    if (is_exact ? (pt == type) : !case_type_is_exact(pt)) alts.append(Obj::with_Int(i));
+  }
+  Obj arr = alts.len() ? Cmpd_from_Array(t_Arr_Int.ret(), alts.array()) : obj0;
+  alts.dealloc();
+  return arr;
+}
+
+
+static Case_table* case_table_build(Trace* t, Obj env, Obj code) {
+  Obj exprs = code.cmpd_el(0);
+  Int len_alts = (exprs.cmpd_len() - 1) / 2;
+  Case_table* ct = static_cast<Case_table*>(raw_alloc(size_Case_table, ci_Case_table));
+  memset(ct, 0, Uns(size_Case_table));
+  ct->len_alts = len_alts;
+  ct->pats = Obj::Cmpd_raw(t_Arr_Obj.ret(), len_alts);
+  Int len_ints = 0;
+  Int min = max_Int;
+  Int max = -max_Int;
+  List deps;
+  for_in(i, len_alts) {
+    Obj pat = case_resolve_pat(t, env, code, exprs.cmpd_el(i * 2 + 1), deps);
+    ct->pats.cmpd_put(i, pat);
+    if (pat.is_int()) {
+      len_ints++;
+      min = int_min(min, pat.int_val());
+      max = int_max(max, pat.int_val());
+    }
+  }
+  ct->deps = deps.len() ? Cmpd_from_Array(t_Arr_Obj.ret(), deps.array()) : obj0;
+  deps.dealloc();
+  if (len_ints >= case_jump_min_keys && max - min < int_min(len_ints * 2, case_jump_max_len)) {
+    ct->jump_min = min;
+    ct->jump_len = max - min + 1;
+    Int size = ct->jump_len * size_Int;
+    ct->jump = static_cast<Int*>(raw_alloc(size, ci_Case_table));
+    memset(ct->jump, 0, Uns(size));
+  }
+  for_in(i, len_alts) {
+    Obj pat = ct->pats.cmpd_el(i);
+    if (pat.is_int() && ct->jump) {
+      Int* j = ct->jump + (pat.int_val() - ct->jump_min);
+      if (!*j) *j = i + 1;
+    } else if (!pat.is_ref()) {
+      if (!ct->vals.contains(pat)) ct->vals.insert(pat.ret_val(), Obj::with_Int(i));
+    } else {
+      Obj type = case_pat_type(pat);
+      if (case_type_is_exact(type) && !ct->types.contains(type)) {
+        ct->types.insert(type.ret(), case_alts_of_type(ct->pats, type, true));
+      }
+    }
+  }
+  ct->generic = case_alts_of_type(ct->pats, obj0, false);
+  return ct;
+}
+
+
+static Bool case_pat_matches(Obj pat, Obj val) {
+  // borrows pat, val.
+  if (!pat.is_ref()) return pat == val;
+  if (pat.ref_type() == t_Type) return val_conforms(val, pat);
+  assert(pat.ref_type() == t_Arr_Obj);
+  if (val.type() != pat.cmpd_el(0)) return false;
+  for_in(i, val.cmpd_len()) {
+    if (!case_pat_matches(pat.cmpd_el(i + 1), val.cmpd_el(i))) return false;
+  }
+  return true;
+}
+
+
+static Int case_match_alts(Case_table* ct, Obj alts, Obj val, Int best) {
+  // returns the first alternative in alts before best that matches val, or best.
+  for_val(el, alts.cmpd_it()) {
+    Int i = el.int_val();
+    if (i >= best) break;
+    if (case_pat_matches(ct->pats.cmpd_el(i), val)) return i;
+  }
+  return best;
+}
+
+
+static Int case_match(Case_table* ct, Obj val) {
+  // returns the index of the first alternative that matches val, or len_alts.
+  Int best = ct->len_alts;
+  if (val.is_int() && ct->jump) {
+    Uns k = Uns(val.int_val() - ct->jump_min);
+    if (k < Uns(ct->jump_len) && ct->jump[k]) best = ct->jump[k] - 1;
+  } else if (!val.is_ref()) {
+    Obj i = ct->vals.fetch(val);
+    if (i.vld()) best = i.int_val();
+  }
+  Obj alts = ct->types.fetch(val.type());
+  if (alts.vld()) best = case_match_alts(ct, alts, val, best);
+  if (ct->generic.vld()) best = case_match_alts(ct, ct->generic, val, best);
+  return best;
+}
+
+
+static Bool case_deps_match(Case_table* ct, Obj env) {
+  // true if each pattern sym resolved by case_table_build is still bound to the same Type.
+  if (!ct->deps.vld()) return true;
+  for_imns(i, 0, ct->deps.cmpd_len(), 2) {
+    if (env_get(env, ct->deps.cmpd_el(i)) != ct->deps.cmpd_el(i + 1)) return false;
+  }
+  return true;
+}
+
+
+static Step run_Case(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  exc_check(len > 0, "Case requires a subject");
+  Step step = run(d, t, env, exprs.cmpd_el(0));
+  env = step.res.env;
+  Obj val = step.res.val;
+  Case_table** slot = case_table_slot(code);
+  if (*slot && !case_deps_match(*slot, env)) case_table_release(code);
+  if (!*slot) *slot = case_table_build(t, env, code);
+  Int i = case_match(*slot, val);
+  val.rel();
+  if (i < (*slot)->len_alts) return Step(env, env, exprs.cmpd_el(i * 2 + 2));
+  if (len % 2 == 0) return Step(env, env, exprs.cmpd_el(len - 1)); // default.
+  return Step(env, s_void.ret_val());
+}
+
+
+// Func_dec is the pre-decoded, validated form of a Func, so that the call path need not
+// re-extract and re-check the fields on every call.
+// every Func has a hidden word after its elements (see Cmpd_raw) that points to its Func_dec,
+// or is null if the Func has not been decoded; run_Fn decodes eagerly,
+// while Funcs constructed by other means (host_init_func, CONS) are decoded on first call.
+// the Func_dec borrows env and body from the Func, and owns references to the par fields.
+// any in-place mutation of a Cmpd must call func_dec_invalidate first.
+
+struct Func_dec_par {
+  Obj name;
+  Obj type;
+  Obj dflt; // s_void if the par has no default expression.
+  Bool is_typed; // a fn par with a declared type other than Obj, checked at binding.
+} ALIGNED_TO_WORD;
+DEF_SIZE(Func_dec_par);
+
+struct Func_dec {
+  Bool is_native;
+  Bool is_fn; // callable: not a macro, and ret-type is Obj.
+  Bool is_macro; // expandable: a macro, and ret-type is Expr.
+  Bool has_dflts; // binding may run par default expressions, which could invalidate the Func_dec.
+  Bool is_simple; // no variad or assoc par.
+  Bool is_detached; // invalidated while pinned; freed by the last unpin.
+  Bool is_variad_read; // the variad par might be read; otherwise it is not materialized.
+  Bool is_assoc_read; // the assoc par might be read; otherwise it is not materialized.
+  Int pins;
+  Int len_pars;
+  Int i_variad; // -1 if there is no variad par.
+  Int i_assoc; // -1 if there is no assoc par.
+  Obj lex_env;
+  Obj body;
+  Obj memo; // for a memoized Func: the Memo node that wraps its body (see memo); or obj0.
+} ALIGNED_TO_WORD;
+DEF_SIZE(Func_dec);
+
+
+static Func_dec** func_dec_slot(Obj f) {
+  assert(f.ref_type() == t_Func);
+  return reinterpret_cast<Func_dec**>(f.cmpd_els_unchecked() + f.cmpd_len());
+}
+
+
+static Func_dec_par* func_dec_pars(Func_dec* fd) {
+  return reinterpret_cast<Func_dec_par*>(fd + 1); // address past Func_dec header.
+}
+
+
+static void func_dec_free(Func_dec* fd) {
+  assert(!fd->pins);
+  Func_dec_par* pars = func_dec_pars(fd);
+  for_in(i, fd->len_pars) {
+    pars[i].name.rel();
+    pars[i].type.rel();
+    pars[i].dflt.rel();
+  }
+  raw_dealloc(fd, ci_Func_dec);
+}
+
+
+// counts the in-place mutations of Funcs, so that Inlined nodes can detect them (see run_Inlined).
+static Int func_mutation_count = 0;
+
+
+static void func_dec_release(Obj o) {
+  // release the Func_dec of Func o, if any.
+  Func_dec** slot = func_dec_slot(o);
+  Func_dec* fd = *slot;
+  if (!fd) return;
+  *slot = null;
+  if (fd->pins) {
+    fd->is_detached = true;
+  } else {
+    func_dec_free(fd);
+  }
+}
+
+
+static void func_dec_invalidate(Obj o) {
+  // called before an in-place mutation of o; if o is a Func, release its Func_dec, if any.
+  if (o.ref_type() != t_Func) return;
+  func_mutation_count++;
+  func_dec_release(o);
+}
+
+
+static void func_dec_unpin(Func_dec* fd) {
+  assert(fd->pins > 0);
+  fd->pins--;
+  if (!fd->pins && fd->is_detached) func_dec_free(fd);
+}
+
+
+static Bool func_dec_may_read_par(Obj func, Obj par) {
+  // true if the body or the par default exprs of func might look up the name of par.
+  // host functions read their pars from the env, so they are assumed to read all of them.
+  if (!func.cmpd_el(0).is_true_bool()) return true;
+  Obj name = par.cmpd_el(0);
+  if (compile_may_read_sym(func.cmpd_el(7), name)) return true;
+  for_val(p, func.cmpd_el(6).cmpd_it()) {
+    if (compile_may_read_sym(p.cmpd_el(2), name)) return true;
+  }
+  return false;
+}
+
+
+static Func_dec* func_decode(Trace* t, Obj func) {
+  // validate func and create its Func_dec.
+  assert(func.cmpd_len() == 8);
+  Obj is_native = func.cmpd_el(0);
+  Obj is_macro  = func.cmpd_el(1);
+  Obj lex_env   = func.cmpd_el(2);
+  Obj ret_type  = func.cmpd_el(3);
+  Obj variad    = func.cmpd_el(4);
+  Obj assoc     = func.cmpd_el(5);
+  Obj pars      = func.cmpd_el(6);
+  Obj body      = func.cmpd_el(7);
+  Obj memo = obj0;
+  if (body.type() == t_Memo) { // memoized Func; the node must wrap the actual body.
+    exc_check(body.cmpd_len() == 4, "func: %o\nMemo requires 4 fields; received %i",
+      func, body.cmpd_len());
+    memo = body;
+    body = memo.cmpd_el(3);
+  }
+  exc_check(is_native.is_bool(), "func: %o\nis-native is not a Bool: %o", func, is_native);
+  exc_check(is_macro.is_bool(), "func: %o\nis-macro is not a Bool: %o", func, is_macro);
+  exc_check(lex_env == s_ENV_END || lex_env.is_env(),
+    "func: %o\nenv is not an Env: %o", func, lex_env);
+  exc_check(pars.type() == t_Arr_Par, "func: %o\npars is not an Arr-Par: %o", func, pars);
+  exc_check(is_native.is_true_bool() || body.is_ptr(),
+    "host func: %o\nbody is not a Ptr: %o", func, body);
+  Int len_pars = pars.cmpd_len();
+  Int i_variad = -1;
+  Int i_assoc = -1;
+  Bool has_dflts = false;
+  for_in(i, len_pars) {
+    Obj par = pars.cmpd_el(i);
+    exc_check(par.type() == t_Par, "func: %o\nparameter %i is malformed: %o", func, i, par);
+    Obj dflt = par.cmpd_el(2);
+    if (par == variad) {
+      exc_check(i_variad < 0, "func: %o\nmultiple variad parameters", func);
+      exc_check(dflt == s_void, "variad parameter has non-void default argument: %o", par);
+      i_variad = i;
+    } else if (par == assoc) {
+      exc_check(dflt == s_void, "assoc parameter has non-void default argument: %o", par);
+      if (i_assoc < 0) i_assoc = i;
+    } else if (dflt != s_void) {
+      has_dflts = true;
+    }
+  }
+  exc_check(variad == s_void || i_variad >= 0,
+    "func: %o\nvariad is not one of the parameters: %o", func, variad);
+  exc_check(assoc == s_void || i_assoc >= 0,
+    "func: %o\nassoc is not one of the parameters: %o", func, assoc);
+  Func_dec* fd = static_cast<Func_dec*>(
+    raw_alloc(size_Func_dec + size_Func_dec_par * len_pars, ci_Func_dec));
+  Bool is_macro_val = is_macro.is_true_bool();
+  fd->is_native = is_native.is_true_bool();
+  fd->is_fn = !is_macro_val && ret_type == t_Obj;
+  fd->is_macro = is_macro_val && ret_type == t_Expr;
+  fd->has_dflts = has_dflts;
+  fd->is_simple = i_variad < 0 && i_assoc < 0;
+  fd->is_detached = false;
+  fd->is_variad_read = i_variad >= 0 && func_dec_may_read_par(func, pars.cmpd_el(i_variad));
+  fd->is_assoc_read = i_assoc >= 0 && func_dec_may_read_par(func, pars.cmpd_el(i_assoc));
+  fd->pins = 0;
+  fd->len_pars = len_pars;
+  fd->i_variad = i_variad;
+  fd->i_assoc = i_assoc;
+  fd->lex_env = lex_env;
+  fd->body = body;
+  fd->memo = memo;
+  Func_dec_par* dec_pars = func_dec_pars(fd);
+  for_in(i, len_pars) {
+    Obj par = pars.cmpd_el(i);
+    Obj type = par.cmpd_el(1);
+    dec_pars[i].name = par.cmpd_el(0).ret();
+    dec_pars[i].type = type.ret();
+    dec_pars[i].dflt = par.cmpd_el(2).ret();
+    // macro pars are always Expr; host funcs leave their pars untyped, as nil.
+    dec_pars[i].is_typed = !is_macro_val && i != i_variad && par != assoc
+      && type.is_type() && type != t_Obj;
+  }
+  return fd;
+}
+
+
+static Func_dec* func_dec(Trace* t, Obj func) {
+  // return the Func_dec for func, decoding it if necessary.
+  Func_dec** slot = func_dec_slot(func);
+  if (!*slot) {
+    *slot = func_decode(t, func);
+  }
+  return *slot;
+}
+
+
+static Obj run_capture_env(Obj env, Obj code) {
+  // borrows env, code.
+  // returns the env to be captured by the Func for code: a compact env holding the innermost
+  // binding of each sym recorded by compile_record_fn_syms, or all of env if none were recorded.
+  Obj syms = *compile_fn_syms_slot(code);
+  if (!syms.vld()) return env.ret();
+  Int len = syms.cmpd_len();
+  if (len > width_Word) return env.ret(); // the found mask below is a single word.
+  Obj* els = syms.cmpd_els();
+  Uns all = (len == width_Word) ? ~Uns(0) : (Uns(1) << len) - 1;
+  Uns found = 0;
+  Obj captured = s_ENV_END.ret_val();
+  for (Obj e = env; e != s_ENV_END && found != all; e = e.e->tl) {
+    Obj key = e.e->key;
+    for_in(i, len) {
+      if (els[i] == key && !(found & (Uns(1) << i))) {
+        found |= Uns(1) << i;
+        captured = env_new(e.e->is_public, key.ret_val(), e.e->val.ret(), captured);
+        break;
+      }
+    }
+  }
+  return captured;
+}
+
+
+static Step run_Fn(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  exc_check(code.cmpd_len() == 4, "Fn requires 4 fields; received %i", code.cmpd_len());
+  Obj is_native = code.cmpd_el(0);
+  Obj is_macro  = code.cmpd_el(1);
+  Obj pars_seq  = code.cmpd_el(2);
+  Obj body      = code.cmpd_el(3);
+  exc_check(is_macro.is_bool(), "Fn: is-macro is not a Bool: %o", is_macro);
+  Bool is_macro_val = is_macro.is_true_bool();
+  Obj ret_type = is_macro_val ? t_Expr : t_Obj;
+  exc_check(pars_seq.type() == t_Syn_seq, "Fn: pars is not a sequence literal: %o", pars_seq);
+  assert(pars_seq.cmpd_len() == 1); // single element: the array of expressions.
+  Obj pars_exprs = pars_seq.cmpd_el(0);
+  Int len_pars = pars_exprs.cmpd_len();
+  Obj pars = Obj::Cmpd_raw(t_Arr_Par.ret(), len_pars);
+  Obj variad = s_void.ret_val();
+  Obj assoc = s_void.ret_val();
+  for_in(i, len_pars) {
+    Obj syn = pars_exprs.cmpd_el(i);
+    Obj syn_type = syn.type();
+    Obj par_name;
+    Obj par_type_expr;
+    Obj par_type;
+    Obj par_dflt;
+    Bool is_variad = false;
+    Bool is_assoc = false;
+    if (syn_type == t_Label) {
+      par_name = syn.cmpd_el(0).ret();
+      exc_check(par_name.is_sym(), "Fn: par name is not sym: %o", syn);
+      par_type_expr = syn.cmpd_el(1);
+      par_dflt = syn.cmpd_el(2).ret();
+      if (is_macro_val) {
+        exc_check(par_type_expr == s_nil, "Fn: macro par type must be nil:  %o", syn);
+        par_type = t_Expr.ret();
+      } else {
+        Step step = run(d, t, env, par_type_expr);
+        env = step.res.env;
+        par_type = step.res.val;
+        if (par_type == s_nil) {
+          par_type.rel_val();
+          par_type = t_Obj.ret();
+        }
+        exc_check(par_type.is_type(), "Fn: par expected a type: %o\nreceived: %o", syn, par_type);
+      }
+    } else if (syn_type == t_Variad) {
+      Obj par_hd = syn.cmpd_el(0);
+      par_dflt = s_void.ret_val(); // TODO: change to s_nil?
+      if (par_hd.type() == t_Variad) { // nested variad indicates assoc.
+        exc_check(syn.cmpd_el(1) == s_nil,
+          "Fn: assoc par invalid syntax (second/nested type clause): %o", syn);
+        exc_check(!is_macro_val, "Fn: macros do not support assoc pars: %o", syn);
+        is_assoc = true;
+        par_name = par_hd.cmpd_el(0).ret();
+        exc_check(par_name.is_sym(), "Fn: par name is not sym: %o", syn);
+        par_type_expr = par_hd.cmpd_el(1);
+        Step step = run(d, t, env, par_type_expr);
+        env = step.res.env;
+        Obj el_type = step.res.val;
+        exc_check(el_type.is_type(), "Fn: assoc par expected a type: %o\nreceived: %o",
+          syn, el_type);
+        par_type = labeled_args_type(el_type);
+        el_type.rel();
+      } else {
+        is_variad = true;
+        par_name = par_hd.ret();
+        exc_check(par_name.is_sym(), "Fn: par name is not sym: %o", syn);
+        par_type_expr = syn.cmpd_el(1);
+        if (is_macro_val) {
+          exc_check(par_type_expr == s_nil, "Fn: macro variad par type must be nil:  %o", syn);
+          par_type = t_Arr_Expr.ret();
+        } else {
+          Step step = run(d, t, env, par_type_expr);
+          env = step.res.env;
+          Obj el_type = step.res.val;
+          if (el_type == s_nil) {
+            el_type.rel_val();
+            el_type = t_Obj.ret();
+          }
+          exc_check(el_type.is_type(), "Fn: variad par expected a type: %o\nreceived: %o",
+            syn, el_type);
+          par_type = arr_type(el_type);
+          el_type.rel();
+        }
+      }
+    } else {
+      exc_raise("Fn: parameter %i is neither Label nor Variad: %o", i, syn);
+    }
+    Obj par =  Obj::Cmpd(t_Par.ret(), par_name, par_type, par_dflt);
+    pars.cmpd_put(i, par);
+    if (is_variad) {
+      exc_check(variad == s_void, "Fn: multiple variadic parameters: %o", syn);
+      variad.rel_val();
+      variad = par.ret();
+    } else if (is_assoc) {
+      exc_check(assoc == s_void, "Fn: multiple assoc parameters: %o", syn);
+      assoc.rel_val();
+      assoc = par.ret();
+    }
+  }
+  Obj f = Obj::Cmpd(t_Func.ret(),
+    is_native.ret_val(),
+    is_macro.ret_val(),
+    run_capture_env(env, code),
+    ret_type.ret(),
+    variad,
+    assoc,
+    pars,
+    body.ret());
+  *func_dec_slot(f) = func_decode(t, f);
+  return Step(env, f);
+}
+
+
+#define UNPACK_LABEL(l) \
+Obj l##_el_name = l.cmpd_el(0); \
+Obj l##_el_type = l.cmpd_el(1); \
+Obj l##_el_expr = l.cmpd_el(2)
+
+#define UNPACK_VARIAD(v) \
+Obj v##_el_expr = v.cmpd_el(0); \
+Obj v##_el_type = v.cmpd_el(1)
+
+
+COLD static void bind_type_error(Trace* t, Obj call, Func_dec_par* par, Obj val) {
+  exc_raise("call: %o\nparameter: %o\nrequires type: %o\nreceived: %o",
+    call, par->name, type_name(par->type), val);
+}
+
+
+static inline void bind_check_type(Trace* t, Obj call, Func_dec_par* par, Obj val) {
+  if (par->is_typed && !val_conforms(val, par->type)) bind_type_error(t, call, par, val);
+}
+
+
+static Obj bind_par(Int d, Trace* t, Obj env, Obj call, Func_dec_par* par, Array vals,
+  Int* i_vals) {
+  // owns env.
+  Obj val;
+  Int i = *i_vals;
+  if (i < vals.len()) {
+    Obj arg_name = vals.el_move(i++);
+    Obj arg = vals.el_move(i++);
+    *i_vals = i;
+    exc_check(!arg_name.vld() || par->name == arg_name,
+      "call: %o\nparameter: %o\ndoes not match argument label %i: %o\narg: %o",
+       call, par->name, i, arg_name, arg);
+    val = arg;
+  } else if (par->dflt != s_void) { // use parameter default expression.
+    Step step = run(d, t, env, par->dflt);
+    env = step.res.env;
+    val = step.res.val;
+  } else {
+    exc_raise("call: %o\nreceived too few arguments", call);
+  }
+  bind_check_type(t, call, par, val);
+  env = bind_val(t, env, false, par->name.ret_val(), val);
+  return env;
+}
+
+
+// variad and assoc packs.
+// when the body of a native fn cannot read its variad or assoc par (see func_dec_may_read_par),
+// the par is left unbound and its args are released, so that no pack is allocated.
+// when a call splices an Arr into the variad of a native fn, and the spliced elements are exactly
+// the variad args, and the Arr has no other references, run_Call passes the Arr itself,
+// marked by the SPLICED_ARR name, and the variad par is bound to it without copying
+// (see run_call_splice_forwards); a shared Arr is copied, so that the callee cannot mutate it.
+
+static Obj bind_variad(Trace* t, Obj env, Func_dec* fd, Func_dec_par* par, Array vals,
+  Int* i_vals) {
+  // owns env.
+  Int start = *i_vals;
+  Int end = vals.len();
+  if (start < end && vals.el(start) == s_SPLICED_ARR) { // forwarded Arr.
+    assert(start + 2 == end);
+    *i_vals = end;
+    vals.el_move(start);
+    Obj vrd = vals.el_move(start + 1);
+    if (!fd->is_variad_read) {
+      vrd.rel();
+      return env;
+    }
+    return bind_val(t, env, false, par->name.ret_val(), vrd);
+  }
+  for_imns(i, start, end, 2) {
+    if (vals.el(i).vld()) { // labeled arg; terminate variad.
+      end = i;
+      break;
+    }
+  }
+  *i_vals = end;
+  if (!fd->is_variad_read) {
+    for_imns(i, start + 1, end, 2) {
+      vals.el_move(i).rel();
+    }
+    return env;
+  }
+  Int len = (end - start) / 2;
+  Obj vrd = Obj::Cmpd_raw(par->type.ret(), len);
+  Int j = 0;
+  for_imns(i, start + 1, end, 2) {
+    Obj arg = vals.el_move(i);
+    vrd.cmpd_put(j++, arg);
+  }
+  env = bind_val(t, env, false, par->name.ret_val(), vrd);
+  return env;
+}
+
+
+static Obj bind_assoc(Trace* t, Obj env, Func_dec* fd, Func_dec_par* par, Array vals, Int start) {
+  // owns env.
+  Int end = vals.len();
+  if (!fd->is_assoc_read) {
+    for_imns(ik, start, end, 2) {
+      Int iv = ik + 1;
+      Obj name = vals.el_move(ik);
+      Obj arg = vals.el_move(iv);
+      exc_check(name.vld(), "arg %i is not labeled", iv / 2);
+      arg.rel();
+    }
+    return env;
+  }
+  Int len = (end - start) / 2;
+  Obj keys = Obj::Cmpd_raw(t_Arr_Sym.ret(), len);
+  Obj assoc_vals = Obj::Cmpd_raw(t_Arr_Obj.ret(), len);
+  Obj assoc = Obj::Cmpd(par->type.ret(), keys, assoc_vals);
+  Int j = 0;
+  for_imns(ik, start, end, 2) {
+    Int iv = ik + 1;
+    Obj name = vals.el_move(ik);
+    Obj arg = vals.el_move(iv);
+    exc_check(name.vld(), "arg %i is not labeled", iv / 2);
+    keys.cmpd_put(j, name.ret_val()); // name is not already owned.
+    assoc_vals.cmpd_put(j++, arg);
+  }
+  env = bind_val(t,  env, false, par->name.ret_val(), assoc);
+  return env;
+}
+
+
+static Obj bind_arg(Trace* t, Obj env, Obj call, Func_dec_par* par, Array vals, Int i) {
+  // owns env.
+  // bind the name, value pair at index i to par; a positional argument for a simple func.
+  Obj arg_name = vals.el_move(i);
+  Obj arg = vals.el_move(i + 1);
+  exc_check(!arg_name.vld() || par->name == arg_name,
+    "call: %o\nparameter: %o\ndoes not match argument label %i: %o\narg: %o",
+     call, par->name, i + 2, arg_name, arg);
+  bind_check_type(t, call, par, arg);
+  return bind_val(t, env, false, par->name.ret_val(), arg);
+}
+
+
+static Obj run_bind_vals(Int d, Trace* t, Obj env, Obj call, Func_dec* fd, Array vals) {
+  // owns env.
+  env = bind_val(t, env, false, s_self.ret_val(), vals.el_move(0));
+  Func_dec_par* pars = func_dec_pars(fd);
+  if (fd->is_simple && vals.len() == fd->len_pars * 2 + 1) {
+    // common case: one argument per par, so no defaults, variad scan, or assoc.
+    switch (fd->len_pars) {
+      case 0:
+        return env;
+      case 1:
+        return bind_arg(t, env, call, pars, vals, 1);
+      case 2:
+        env = bind_arg(t, env, call, pars, vals, 1);
+        return bind_arg(t, env, call, pars + 1, vals, 3);
+      case 3:
+        env = bind_arg(t, env, call, pars, vals, 1);
+        env = bind_arg(t, env, call, pars + 1, vals, 3);
+        return bind_arg(t, env, call, pars + 2, vals, 5);
+      default:
+        for_in(i_pars, fd->len_pars) {
+          env = bind_arg(t, env, call, pars + i_pars, vals, i_pars * 2 + 1);
+        }
+        return env;
+    }
+  }
+  Int i_vals = 1; // first name of the interleaved name/value pairs.
+  for_in(i_pars, fd->len_pars) {
+    assert(i_vals <= vals.len() && i_vals % 2 == 1);
+    Func_dec_par* par = pars + i_pars;
+    if (i_pars == fd->i_variad) {
+      env = bind_variad(t, env, fd, par, vals, &i_vals);
+    } else if (i_pars == fd->i_assoc) {
+      return bind_assoc(t, env, fd, par, vals, i_vals);
+    } else {
+      env = bind_par(d, t, env, call, par, vals, &i_vals);
+    }
+  }
+  exc_check(i_vals == vals.len(), "call: %o\nreceived too many arguments; bound %i; received %i",
+    call, i_vals / 2, vals.len() / 2);
+  return env;
+}
+
+
+#if OPTION_TCO
+static Obj run_reuse_frame(Obj env, Obj func, Func_dec* fd) {
+  // for a self tail call, env is the frame of a previous call to func, abandoned by run_tail.
+  // if every binding down to and including the frame boundary is uniquely owned,
+  // then release the body bindings above the pars and return the topmost par binding,
+  // which the caller rebinds in place.
+  // otherwise, return obj0; env is unchanged and still owned by the caller.
+  Int len_binds = 0; // bindings above the frame boundary.
+  Obj e = env;
+  while (e != s_ENV_END && e.e->key != s_ENV_FRAME_KEY) {
+    if (!e.is_unique()) return obj0;
+    e = e.e->tl;
+    len_binds++;
+  }
+  if (e == s_ENV_END || !e.is_unique() || e.e->tl != fd->lex_env) return obj0;
+  Int len_body = len_binds - fd->len_pars - 1; // bindings above the pars.
+  if (len_body < 0) return obj0;
+  Obj top = env;
+  for_in(i, len_body) {
+    top = top.e->tl;
+  }
+  // check that the frame has the shape of the func: self and the pars, in binding order.
+  Func_dec_par* pars = func_dec_pars(fd);
+  e = top;
+  for_in_rev(i, fd->len_pars) {
+    if (e.e->key != pars[i].name) return obj0;
+    e = e.e->tl;
+  }
+  if (e.e->key != s_self || e.e->val != func) return obj0;
+  if (len_body) {
+    top.ret();
+    env.rel(); // releases the body bindings, leaving top uniquely owned.
+  }
+  return top;
+}
+#endif
+
+
+static Step run_call_Func_dec(Int d, Trace* t, Obj env, Obj call, Array vals, Bool is_call,
+  Func_dec* fd) {
+  // owns env, the elements of vals, including func, whose Func_dec is fd.
+  Obj func = vals.el(0);
+  if (!(is_call ? fd->is_fn : fd->is_macro)) {
+    Obj is_macro = func.cmpd_el(1);
+    Obj ret_type = func.cmpd_el(3);
+    if (is_call) {
+      exc_check(!is_macro.is_true_bool(), "cannot call macro");
+      exc_raise("fn ret-type is not Obj: %o", ret_type); // TODO: improve.
+    } else {
+      exc_check(is_macro.is_true_bool(), "cannot expand function");
+      exc_raise("macro ret-type is not Expr: %o", ret_type);
+    }
+  }
+  Bool is_native = fd->is_native;
+  Obj body = fd->body;
+#if OPTION_TCO
+  if (t->is_env_abandoned && is_native && fd->is_simple && vals.len() == fd->len_pars * 2 + 1) {
+    // self tail call: rebind the pars of the abandoned frame in place, instead of pushing a new one.
+    Obj frame_env = run_reuse_frame(env, func, fd);
+    if (frame_env.vld()) {
+      Func_dec_par* pars = func_dec_pars(fd);
+      Obj e = frame_env;
+      for_in_rev(i, fd->len_pars) {
+        Obj arg_name = vals.el_move(i * 2 + 1);
+        Obj arg = vals.el_move(i * 2 + 2);
+        exc_check(!arg_name.vld() || pars[i].name == arg_name,
+          "call: %o\nparameter: %o\ndoes not match argument label %i: %o\narg: %o",
+          call, pars[i].name, i * 2 + 3, arg_name, arg);
+        bind_check_type(t, call, pars + i, arg);
+        e.e->val.rel();
+        e.e->val = arg;
+        e = e.e->tl;
+      }
+      vals.el_move(0).rel(); // func remains bound to self.
+      // a local step: the frame continues as the env of the tail step.
+      return Step(frame_env, frame_env, body);
+    }
+  }
+#endif
+  Obj callee_env = env_push_frame(fd->lex_env.ret());
+  // NOTE: because func is bound to self in callee_env, and func contains body,
+  // we can give func to callee_env and still safely return the unretained body as tail.code.
+  // default expressions may mutate func, so pin fd while binding.
+  if (fd->has_dflts) fd->pins++;
+  callee_env = run_bind_vals(d, t, callee_env, call, fd, vals);
+  if (fd->has_dflts) func_dec_unpin(fd);
+  if (is_native) {
+#if OPTION_TCO
+    // caller will own env, callee_env, but not .code.
+    return Step(env, callee_env, body);
+#else // NO TCO.
+    Step step = run(d, t, callee_env, body); // owns callee_env.
+    step.res.env.rel();
+    step.res.env = env; // keep any extra values.
+    return step; // NO TCO.
+#endif
+  } else { // host function.
+    Func_host_ptr f_ptr = Func_host_ptr(body.ptr());
+    Obj res = f_ptr(t, callee_env);
+    callee_env.rel();
+    return Step(env, res); // NO TCO.
+  }
+}
+
+
+// memoized fns.
+// memo-func returns a copy of a fn whose body is wrapped in a Memo node, which holds the fields
+// below as options, and caches results in its hidden word (see Cmpd_raw).
+// func_decode unwraps the node into fd->memo; since each call binds self to the copy,
+// recursive calls through self (as made by let-fn) also go through the cache.
+// the key of a call is its Arr of arg values; calls with labeled args bypass the cache.
+// keys are compared by identity (`id), or structurally (`val): Data by bytes, Cmpd by type and
+// elements, to a limited depth. the cache holds up to capacity entries, and evicts either the
+// least recently used (`lru), or the first that the clock hand finds not hit since it last
+// passed (`clock). an `id entry whose key holds the last reference to one of its args can never
+// be hit again; so that the cache does not keep such dead keys alive, every memo_sweep_period
+// calls a sweep visits the next memo_sweep_len entries, and drops those whose keys, vals and extra
+// values hold the only references to any element of the key. references from within vals are
+// counted down to memo_max_depth, through Cmpds that no other object holds.
+// `val keys stand for their values, which can still be hit, so are only evicted.
+// a call that returns multiple values (see run_Values) caches the extra values with its val,
+// and a hit restores them to run_vals.
+
+struct Memo_entry {
+  Obj key; // Arr-Obj of the arg values; or obj0 if the entry is free.
+  Obj val;
+  Obj extra; // Arr-Obj of the extra values returned with val; or obj0.
+  Uns hash;
+  Int next; // the next entry in the same bucket, or in the free list; or -1.
+  Int newer; // for lru: the adjacent entries in order of use; or -1.
+  Int older;
+  Bool is_hit; // for clock: hit since the hand last passed.
+} ALIGNED_TO_WORD;
+DEF_SIZE(Memo_entry);
+
+struct Memo_cache {
+  Int capacity;
+  Bool is_clock;
+  Bool is_by_val;
+  Int len;
+  Int len_buckets; // a power of two.
+  Int* buckets; // the first entry in each bucket; or -1.
+  Memo_entry* entries;
+  Int free; // the first free entry; or -1.
+  Int newest; // for lru: the most and least recently used entries; or -1.
+  Int oldest;
+  Int hand; // for clock: the next entry to consider for eviction.
+  Int calls_to_sweep; // calls remaining before the next sweep for dead keys.
+  Int sweep_hand; // the next entry for a sweep to visit.
+  Int hits;
+  Int misses;
+  Int evictions; // entries evicted to make room.
+  Int drops; // entries dropped by sweeps because their keys were dead.
+} ALIGNED_TO_WORD;
+DEF_SIZE(Memo_cache);
+
+static const Int memo_max_capacity = 1<<20;
+static const Int memo_max_depth = 8; // the depth to which `val keys are hashed and compared.
+static const Int memo_sweep_period = 64; // calls between sweeps for dead keys.
+static const Int memo_sweep_len = 256; // the entries visited by each sweep.
+
+
+static Memo_cache** memo_cache_slot(Obj o) {
+  assert(o.ref_type() == t_Memo);
+  return reinterpret_cast<Memo_cache**>(o.cmpd_els_unchecked() + o.cmpd_len());
+}
+
+
+static void memo_cache_release(Obj o) {
+  // free the cache of Memo o, if any.
+  Memo_cache** slot = memo_cache_slot(o);
+  Memo_cache* mc = *slot;
+  if (!mc) return;
+  *slot = null;
+  for_in(i, mc->capacity) {
+    Memo_entry* e = mc->entries + i;
+    if (!e->key.vld()) continue;
+    e->key.rel();
+    e->val.rel();
+    if (e->extra.vld()) e->extra.rel();
+  }
+  raw_dealloc(mc, ci_Memo_cache);
+}
+
+
+static Memo_cache* memo_cache_new(Trace* t, Obj memo) {
+  // validate the options of memo and create its empty cache.
+  Obj capacity = memo.cmpd_el(0);
+  Obj evict = memo.cmpd_el(1);
+  Obj key = memo.cmpd_el(2);
+  exc_check(capacity.is_int() && capacity.int_val() > 0 && capacity.int_val() <= memo_max_capacity,
+    "memo: capacity must be an Int from 1 to %i; received: %o", memo_max_capacity, capacity);
+  exc_check(evict == s_lru || evict == s_clock,
+    "memo: evict must be `lru or `clock; received: %o", evict);
+  exc_check(key == s_id || key == s_val, "memo: key must be `id or `val; received: %o", key);
+  Int cap = capacity.int_val();
+  Int len_buckets = 1;
+  while (len_buckets < cap) len_buckets <<= 1;
+  // the entries and buckets follow the header in a single allocation.
+  Memo_cache* mc = static_cast<Memo_cache*>(raw_alloc(
+    size_Memo_cache + cap * size_Memo_entry + len_buckets * size_Int, ci_Memo_cache));
+  mc->capacity = cap;
+  mc->is_clock = (evict == s_clock);
+  mc->is_by_val = (key == s_val);
+  mc->len = 0;
+  mc->len_buckets = len_buckets;
+  mc->entries = reinterpret_cast<Memo_entry*>(mc + 1);
+  mc->buckets = reinterpret_cast<Int*>(mc->entries + cap);
+  for_in(i, cap) {
+    Memo_entry* e = mc->entries + i;
+    e->key = obj0;
+    e->val = obj0;
+    e->extra = obj0;
+    e->next = (i + 1 < cap) ? i + 1 : -1;
+  }
+  for_in(i, len_buckets) {
+    mc->buckets[i] = -1;
+  }
+  mc->free = 0;
+  mc->newest = -1;
+  mc->oldest = -1;
+  mc->hand = 0;
+  mc->calls_to_sweep = memo_sweep_period;
+  mc->sweep_hand = 0;
+  mc->hits = 0;
+  mc->misses = 0;
+  mc->evictions = 0;
+  mc->drops = 0;
+  return mc;
+}
+
+
+static Uns memo_hash_val(Obj o, Int depth) {
+  // a structural hash, consistent with memo_iso.
+  if (!o.is_ref()) return Uns(o.id_hash());
+  if (o.ref_is_data()) {
+    Uns h = 0xcbf29ce484222325; // FNV-1a.
+    Chars c = o.data_ref_chars();
+    for_in(i, o.data_ref_len()) {
+      h = (h ^ U8(c[i])) * 0x100000001b3;
+    }
+    return h;
+  }
+  if (!o.ref_is_cmpd()) return Uns(o.id_hash());
+  Uns h = Uns(o.ref_type().id_hash());
+  if (depth == memo_max_depth) return h; // deeper elements are compared by identity.
+  for_val(el, o.cmpd_it()) {
+    h = h * 31 + memo_hash_val(el, depth + 1);
+  }
+  return h;
+}
+
+
+static Bool memo_iso(Obj a, Obj b, Int depth) {
+  if (a == b) return true;
+  if (!a.is_ref() || !b.is_ref()) return false;
+  if (a.ref_is_data()) return b.ref_is_data() && a.data_ref_iso(b);
+  if (!a.ref_is_cmpd() || a.ref_type() != b.ref_type() || depth == memo_max_depth) return false;
+  Int len = a.cmpd_len();
+  if (len != b.cmpd_len()) return false;
+  for_in(i, len) {
+    if (!memo_iso(a.cmpd_el(i), b.cmpd_el(i), depth + 1)) return false;
+  }
+  return true;
+}
+
+
+static Uns memo_hash_args(Memo_cache* mc, Obj* args, Int len, Int stride) {
+  Uns h = Uns(len);
+  for_in(i, len) {
+    Obj a = args[i * stride];
+    h = (h ^ (mc->is_by_val ? memo_hash_val(a, 0) : Uns(a.id_hash()))) * 0x100000001b3;
+  }
+  return h;
+}
+
+
+static Int memo_find(Memo_cache* mc, Uns hash, Obj* args, Int len, Int stride) {
+  // returns the index of the entry whose key matches args, or -1.
+  for (Int i = mc->buckets[hash & Uns(mc->len_buckets - 1)]; i >= 0; i = mc->entries[i].next) {
+    Memo_entry* e = mc->entries + i;
+    if (e->hash != hash || e->key.cmpd_len() != len) continue;
+    Obj* key_els = e->key.cmpd_els();
+    Bool is_match = true;
+    for_in(j, len) {
+      Obj k = key_els[j];
+      Obj a = args[j * stride];
+      if (k != a && !(mc->is_by_val && memo_iso(k, a, 0))) {
+        is_match = false;
+        break;
+      }
+    }
+    if (is_match) return i;
+  }
+  return -1;
+}
+
+
+static void memo_lru_unlink(Memo_cache* mc, Int i) {
+  Memo_entry* e = mc->entries + i;
+  if (e->newer >= 0) mc->entries[e->newer].older = e->older; else mc->newest = e->older;
+  if (e->older >= 0) mc->entries[e->older].newer = e->newer; else mc->oldest = e->newer;
+}
+
+
+static void memo_lru_push(Memo_cache* mc, Int i) {
+  // make entry i the most recently used.
+  Memo_entry* e = mc->entries + i;
+  e->newer = -1;
+  e->older = mc->newest;
+  if (mc->newest >= 0) mc->entries[mc->newest].newer = i; else mc->oldest = i;
+  mc->newest = i;
+}
+
+
+static void memo_hit(Memo_cache* mc, Int i) {
+  mc->hits++;
+  if (mc->is_clock) {
+    mc->entries[i].is_hit = true;
+  } else if (mc->newest != i) {
+    memo_lru_unlink(mc, i);
+    memo_lru_push(mc, i);
+  }
+}
+
+
+static void memo_remove(Memo_cache* mc, Int i) {
+  Memo_entry* e = mc->entries + i;
+  Int* link = mc->buckets + (e->hash & Uns(mc->len_buckets - 1));
+  while (*link != i) link = &mc->entries[*link].next;
+  *link = e->next;
+  if (!mc->is_clock) memo_lru_unlink(mc, i);
+  e->key.rel();
+  e->val.rel();
+  if (e->extra.vld()) e->extra.rel();
+  e->key = obj0;
+  e->val = obj0;
+  e->extra = obj0;
+  e->next = mc->free;
+  mc->free = i;
+  mc->len--;
+}
+
+
+static Int memo_victim(Memo_cache* mc) {
+  // choose the entry to evict from a full cache.
+  if (!mc->is_clock) return mc->oldest;
+  loop {
+    Int i = mc->hand;
+    mc->hand = (i + 1 < mc->capacity) ? i + 1 : 0;
+    Memo_entry* e = mc->entries + i;
+    if (!e->is_hit) return i;
+    e->is_hit = false; // second chance.
+  }
+}
+
+
+static void memo_insert(Memo_cache* mc, Uns hash, Obj key, Obj val, Obj extra) {
+  // owns key, val, extra.
+  if (mc->len == mc->capacity) {
+    memo_remove(mc, memo_victim(mc));
+    mc->evictions++;
+  }
+  Int i = mc->free;
+  assert(i >= 0);
+  Memo_entry* e = mc->entries + i;
+  mc->free = e->next;
+  e->key = key;
+  e->val = val;
+  e->extra = extra;
+  e->hash = hash;
+  e->is_hit = false;
+  Int* bucket = mc->buckets + (hash & Uns(mc->len_buckets - 1));
+  e->next = *bucket;
+  *bucket = i;
+  if (!mc->is_clock) memo_lru_push(mc, i);
+  mc->len++;
+}
+
+
+static Uns memo_count_held(Obj o, Obj k, Int depth) {
+  // count the references to k from o, and from the Cmpds within o that only their parents hold,
+  // to memo_max_depth; o is held only by a memo entry.
+  if (o == k) return 1;
+  if (!o.is_ref() || !o.ref_is_cmpd() || depth == memo_max_depth) return 0;
+  if (depth > 0 && o.rc() > 1) return 0; // held elsewhere too, so k may be reachable from there.
+  Uns held = 0;
+  for_val(el, o.cmpd_it()) {
+    held += memo_count_held(el, k, depth + 1);
+  }
+  return held;
+}
+
+
+static Bool memo_key_is_dead(Memo_entry* e) {
+  // true if the key, val and extra values of e hold the only references to some element of the key.
+  Obj* key_els = e->key.cmpd_els();
+  Int len = e->key.cmpd_len();
+  for_in(i, len) {
+    Obj k = key_els[i];
+    if (!k.is_ref()) continue;
+    Uns held = 0;
+    for_in(j, len) {
+      if (key_els[j] == k) held++;
+    }
+    if (e->val.is_ref() && e->val.rc() == 1) held += memo_count_held(e->val, k, 0);
+    else if (e->val == k) held++;
+    if (e->extra.vld()) held += memo_count_held(e->extra, k, 0);
+    if (k.rc() == held) return true;
+  }
+  return false;
+}
+
+
+static void memo_sweep(Memo_cache* mc) {
+  // visit the next memo_sweep_len entries, so that the cost of a sweep does not grow with capacity.
+  mc->calls_to_sweep = memo_sweep_period;
+  Int len = (mc->capacity < memo_sweep_len) ? mc->capacity : memo_sweep_len;
+  for_in(j, len) {
+    Int i = mc->sweep_hand;
+    mc->sweep_hand = (i + 1 < mc->capacity) ? i + 1 : 0;
+    Memo_entry* e = mc->entries + i;
+    if (e->key.vld() && memo_key_is_dead(e)) {
+      memo_remove(mc, i);
+      mc->drops++;
+    }
+  }
+}
+
+
+static Step run_tail(Int d, Trace* parent_trace, Step step);
+
+
+static Int memo_restore_extra(Obj extra) {
+  // borrows extra; replaces the contents of run_vals with its elements, and returns their count.
+  run_vals_clear();
+  Int len = extra.cmpd_len();
+  for_in(i, len) {
+    run_vals[i] = extra.cmpd_el(i).ret();
+  }
+  run_vals_len = len;
+  return len;
+}
+
+
+static Step run_call_memo(Int d, Trace* t, Obj env, Obj call, Array vals, Func_dec* fd) {
+  // owns env, the elements of vals.
+  // a hit returns the cached vals; a miss runs the call to completion, without TCO,
+  // so that its vals can be cached.
+  Obj memo = fd->memo;
+  Memo_cache** slot = memo_cache_slot(memo);
+  if (!*slot) *slot = memo_cache_new(t, memo); // a Memo constructed by CONS.
+  Memo_cache* mc = *slot;
+  Int len = vals.len();
+  for_imns(i, 1, len, 2) {
+    if (vals.el(i).vld()) return run_call_Func_dec(d, t, env, call, vals, true, fd); // labeled.
+  }
+  if (!mc->is_by_val && --mc->calls_to_sweep <= 0) memo_sweep(mc);
+  Obj* args = vals.els() + 2;
+  Int len_args = len / 2;
+  Uns hash = memo_hash_args(mc, args, len_args, 2);
+  Int i = memo_find(mc, hash, args, len_args, 2);
+  if (i >= 0) {
+    memo_hit(mc, i);
+    vals.el_move(0).rel();
+    for_imns(j, 2, len, 2) {
+      vals.el_move(j).rel();
+    }
+    Memo_entry* e = mc->entries + i;
+    Step step(env, e->val.ret());
+    if (e->extra.vld()) step.res.len_extra = memo_restore_extra(e->extra);
+    return step;
+  }
+  mc->misses++;
+  Obj key = Obj::Cmpd_raw(t_Arr_Obj.ret(), len_args);
+  for_in(j, len_args) {
+    key.cmpd_put(j, args[j * 2].ret());
+  }
+  memo.ret(); // the call might release the last reference to the Func, and thus to memo.
+  Step step = run_tail(d, t, run_call_Func_dec(d, t, env, call, vals, true, fd));
+  Obj val = step.res.val;
+  // a reentrant call with the same args may have cached a val already.
+  if (memo_find(mc, hash, key.cmpd_els(), len_args, 1) < 0) {
+    Obj extra = obj0;
+    if (step.res.len_extra) {
+      assert(step.res.len_extra == run_vals_len);
+      extra = Obj::Cmpd_raw(t_Arr_Obj.ret(), run_vals_len);
+      for_in(j, run_vals_len) {
+        extra.cmpd_put(j, run_vals[j].ret());
+      }
+    }
+    memo_insert(mc, hash, key, val.ret(), extra);
+  } else {
+    key.rel();
+  }
+  memo.rel();
+  return step; // retains len_extra.
+}
+
+
+static Step run_call_Func(Int d, Trace* t, Obj env, Obj call, Array vals, Bool is_call) {
+  // owns env, the elements of vals, including func.
+  Obj func = vals.el(0);
+  assert(func.type() == t_Func);
+  Func_dec* fd = func_dec(t, func);
+  if (UNLIKELY(fd->memo.vld()) && is_call) return run_call_memo(d, t, env, call, vals, fd);
+  return run_call_Func_dec(d, t, env, call, vals, is_call, fd);
+}
+
+
+// field access sites.
+// each Accessor and Mutator node caches the field index for the last struct type it accessed,
+// in its hidden word (see Cmpd_raw); a hit skips the linear scan over the field names.
+// the site retains the cached type, so that its address cannot be reused by another type.
+
+struct Access_site {
+  Obj type;
+  Int index;
+};
+DEF_SIZE(Access_site);
+
+
+static Access_site** access_site_slot(Obj o) {
+  assert(o.ref_type() == t_Accessor || o.ref_type() == t_Mutator);
+  return reinterpret_cast<Access_site**>(o.cmpd_els_unchecked() + o.cmpd_len());
+}
+
+
+static void access_site_release(Obj o) {
+  // free the access site cache of Accessor or Mutator o, if any.
+  Access_site** slot = access_site_slot(o);
+  Access_site* site = *slot;
+  if (!site) return;
+  *slot = null;
+  site->type.rel();
+  raw_dealloc(site, ci_Access_site);
+}
+
+
+static Int access_field_index(Obj node, Obj name, Obj type) {
+  // returns the index of the field name in struct type, or -1 if type has no such field.
+  Access_site** slot = access_site_slot(node);
+  Access_site* site = *slot;
+  if (site && site->type == type) return site->index;
+  Obj fields = kind_fields(type.cmpd_el(1));
+  for_in(i, fields.cmpd_len()) {
+    if (fields.cmpd_el(i).cmpd_el(0) == name) {
+      if (!site) {
+        site = static_cast<Access_site*>(raw_alloc(size_Access_site, ci_Access_site));
+        site->type = obj0;
+        *slot = site;
+      }
+      if (site->type.vld()) site->type.rel();
+      *site = {type.ret(), i};
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+COLD static void access_field_error(Trace* t, Chars desc, Obj call, Obj name, Obj type) {
+  errFL("call: %o\n%s field not found: %o\ntype: %o\nfields:", call, desc, name, type_name(type));
+  for_val(e, kind_fields(type.cmpd_el(1)).cmpd_it()) {
+    errFL("  %o", e.cmpd_el(0));
+  }
+  exc_raise("");
+}
+
+
+static Step run_call_Accessor(UNUSED Int d, Trace* t, Obj env, Obj call, Array vals) {
+  // owns env, the elements of vals.
+  exc_check(vals.len() == 3, "call: %o\naccessor requires 1 argument", call);
+  exc_check(!vals.el(1).vld(), "call:%o\naccessee is a label", call);
+  Obj accessor = vals.el_move(0);
+  Obj accessee = vals.el_move(2);
+  assert(accessor.cmpd_len() == 1);
+  Obj name = accessor.cmpd_el(0);
+  exc_check(name.is_sym(), "call: %o\naccessor expr is not a sym: %o", call, name);
+  exc_check(accessee.is_cmpd(), "call: %o\naccessee is not a struct: %o", call, accessee);
+  Obj type = accessee.type();
+  assert(type.type() == t_Type);
+  exc_check(is_kind_struct(type.cmpd_el(1)), "call: %o\naccessee is not a struct: %o",
+    call, accessee);
+  Int i = access_field_index(accessor, name, type);
+  if (i < 0) access_field_error(t, "accessor", call, name, type);
+  assert(kind_fields(type.cmpd_el(1)).cmpd_len() == accessee.cmpd_len());
+  Obj val = accessee.cmpd_el(i).ret();
+  accessor.rel();
+  accessee.rel();
+  return Step(env, val);
+}
+
+
+static Step run_call_Mutator(UNUSED Int d, Trace* t, Obj env, Obj call, Array vals) {
+  // owns env, the elements of vals.
+  exc_check(vals.len() == 5, "call: %o\nmutator requires 2 arguments", call);
+  exc_check(!vals.el(1).vld(), "call:%o\nmutatee is a label", call);
+  exc_check(!vals.el(3).vld(), "call:%o\nmutator expr is a label", call);
+  Obj mutator = vals.el_move(0);
+  Obj mutatee = vals.el_move(2);
+  Obj val = vals.el_move(4);
+  assert(mutator.cmpd_len() == 1);
+  Obj name = mutator.cmpd_el(0);
+  exc_check(name.is_sym(), "call: %o\nmutator expr is not a sym: %o", call, name);
+  exc_check(mutatee.is_cmpd(), "call: %o\nmutatee is not a struct: %o", call, mutatee);
+  Obj type = mutatee.type();
+  assert(type.type() == t_Type);
+  exc_check(is_kind_struct(type.cmpd_el(1)), "call: %o\nmutatee is not a struct: %o",
+    call, mutatee);
+  Int i = access_field_index(mutator, name, type);
+  if (i < 0) access_field_error(t, "mutator", call, name, type);
+  assert(kind_fields(type.cmpd_el(1)).cmpd_len() == mutatee.cmpd_len());
+  func_dec_invalidate(mutatee);
+  mutatee.cmpd_el_move(i).rel();
+  mutatee.cmpd_put(i, val);
+  mutator.rel();
+  return Step(env, mutatee);
+}
+
+
+static Step run_call_EXPAND(UNUSED Int d, Trace* t, Obj env, Obj call, Array vals) {
+  // owns env, the elements of vals.
+  exc_check(vals.len() == 3, "call: %o\n:EXPAND requires 1 argument", call);
+  exc_check(!vals.el(1).vld(), "call: %o\nEXPAND expr is a label", call);
+  Obj callee = vals.el_move(0);
+  Obj expr = vals.el_move(2);
+  callee.rel_val();
+  Obj res = expand(0, env, expr);
+  return Step(env, res);
+}
+
+
+static Step run_call_RUN(Int d, Trace* t, Obj env, Obj call, Array vals) {
+  // owns env, the elements of vals.
+  exc_check(vals.len() == 3, "call: %o\n:RUN requires 1 argument", call);
+  exc_check(!vals.el(1).vld(), "call: %o\nRUN expr is a label", call);
+  Obj callee = vals.el_move(0);
+  Obj expr = vals.el_move(2);
+  callee.rel_val();
+  // for now, perform a non-TCO run so that we do not have to retain expr.
+  Step step = run(d, t, env, expr);
+  expr.rel();
+  return step;
+}
+
+
+static Step run_call_CONS(UNUSED Int d, Trace* t, Obj env, Obj call, Array vals) {
+  exc_check(vals.len() >= 3, "call: %o\nCONS requires a type argument", call);
+  exc_check(!vals.el(1).vld(), "call: %o\nCONS type argument is a label", call);
+  Obj callee = vals.el_move(0);
+  callee.rel_val();
+  Obj type = vals.el_move(2);
+  Obj kind = type_kind(type);
+  Int len = (vals.len() - 3) / 2;
+  Obj res;
+  if (is_kind_struct(kind)) {
+    res = Obj::Cmpd_raw(type, len);
+    Obj fields = kind_fields(kind);
+    Int len_exp = fields.cmpd_len();
+    // TODO: support field defaults.
+    exc_check(len == len_exp, "call: %o\nCONS: type %o expects %i fields; received %i",
+      call, type_name(type), len_exp, len);
+    for_in(i, len) {
+      Obj field = fields.cmpd_el(i);
+      Obj field_name = field.cmpd_el(0);
+      Obj sym = vals.el_move(i * 2 + 3);
+      Obj val = vals.el_move(i * 2 + 4);
+      if (sym.vld()) {
+        exc_check(sym == field_name, "call: %o\nCONS: expected field label: %o; received: %o",
+          call, field_name, sym);
+      }
+      res.cmpd_put(i, val);
+    }
+  } else if (is_kind_arr(kind)) {
+    res = Obj::Cmpd_raw(type, len);
+    for_in(i, len) {
+      Obj sym = vals.el_move(i * 2 + 3);
+      Obj val = vals.el_move(i * 2 + 4);
+      exc_check(!sym.vld(), "call: %o\nCONS: unexpected element label: %o", call, sym);
+      res.cmpd_put(i, val);
+    }
+  } else if (is_kind_unit(kind)) {
+    exc_check(!len, "call: %o\nCONS: unit type expects no arguments: %o", call, type);
+    res = type_unit(type);
+    type.rel();
+  } else {
+    exc_raise("call: %o\nCONS type is not a struct, arr, or unit type", call);
+  }
+  return Step(env, res);
+}
+
+
+static Step run_Call_disp(Int d, Trace* t, Obj env, Obj code, Array vals);
+
+// type-based dispatch.
+// calling an object whose type is a struct runs the dispatcher registered for that type
+// with dispatcher-put; the dispatcher receives the callee and an Arr-Type of the arg types,
+// and returns the function that is then called with the original args.
+// the dispatcher is assumed to depend only on the callee and the arg types,
+// so its result is cached at each call site, keyed by the callee and the arg types.
+// a site holds up to dispatch_site_len_entries keys (monomorphic or polymorphic);
+// once it has seen more, it becomes megamorphic and uses the global direct-mapped cache instead.
+// the site cache is stored in the hidden word of the Call node (see Cmpd_raw), and freed with it.
+// dispatcher-put increments dispatch_epoch, which invalidates all cached entries.
+
+static Dict dispatchers; // maps Type to a single-element Arr-Obj holding the dispatcher.
+static Int dispatch_epoch;
+
+struct Dispatch_entry {
+  Obj callee;
+  Obj types; // Arr-Type.
+  Obj func;
+  Int epoch;
+};
+
+static const Int dispatch_site_len_entries = 4;
+
+struct Dispatch_site {
+  Int len; // entries in use; dispatch_site_megamorphic once the site has seen too many keys.
+  Dispatch_entry entries[dispatch_site_len_entries];
+};
+DEF_SIZE(Dispatch_site);
+
+static const Int dispatch_site_megamorphic = dispatch_site_len_entries + 1;
+
+static const Int len_dispatch_cache = 1<<10;
+static Dispatch_entry dispatch_cache[len_dispatch_cache];
+
+
+static void dispatch_entry_clear(Dispatch_entry& e) {
+  if (!e.callee.vld()) return;
+  e.callee.rel();
+  e.types.rel();
+  e.func.rel();
+  e = {obj0, obj0, obj0, 0};
+}
+
+
+static void dispatch_entry_set(Dispatch_entry& e, Obj callee, Obj types, Obj func) {
+  // borrows callee, func; owns types.
+  dispatch_entry_clear(e);
+  e = {callee.ret(), types, func.ret(), dispatch_epoch};
+}
+
+
+static Dispatch_site** dispatch_site_slot(Obj call) {
+  assert(call.ref_type() == t_Call);
+  return reinterpret_cast<Dispatch_site**>(call.cmpd_els_unchecked() + call.cmpd_len());
+}
+
+
+static void dispatch_site_release(Obj o) {
+  // free the dispatch site cache of Call o, if any.
+  Dispatch_site** slot = dispatch_site_slot(o);
+  Dispatch_site* site = *slot;
+  if (!site) return;
+  *slot = null;
+  for_in(i, dispatch_site_len_entries) {
+    dispatch_entry_clear(site->entries[i]);
+  }
+  raw_dealloc(site, ci_Dispatch_site);
+}
+
+
+static void cmpd_release_hidden(Obj o) {
+  // called by dealloc for instances of the types selected by type_has_hidden;
+  // frees the cache in the hidden word, if any.
+  switch (type_index(o.ref_type())) {
+    case ti_Fn:       compile_fn_syms_release(o); return;
+    case ti_Func:     func_dec_release(o); return;
+    case ti_Call:     dispatch_site_release(o); return;
+    case ti_Accessor:
+    case ti_Mutator:  access_site_release(o); return;
+    case ti_Case:     case_table_release(o); return;
+    case ti_Memo:     memo_cache_release(o); return;
+    default: return; // the index of a Type and the count of an Inlined are not resources.
+  }
+}
+
+
+static Dispatch_site* dispatch_site(Obj call) {
+  // returns the cache for call, allocating it if necessary; or null if call is not a Call.
+  if (call.type() != t_Call) return null; // e.g. the Expand of a macro.
+  Dispatch_site** slot = dispatch_site_slot(call);
+  if (!*slot) {
+    *slot = static_cast<Dispatch_site*>(raw_alloc(size_Dispatch_site, ci_Dispatch_site));
+    memset(*slot, 0, Uns(size_Dispatch_site));
+  }
+  return *slot;
+}
+
+
+static Bool dispatch_entry_matches(Dispatch_entry& e, Obj callee, Array vals) {
+  if (e.callee != callee || e.epoch != dispatch_epoch) return false;
+  Int len_types = (vals.len() - 1) / 2;
+  if (e.types.cmpd_len() != len_types) return false;
+  for_in(i, len_types) {
+    if (e.types.cmpd_el(i) != vals.el(i * 2 + 2).type()) return false;
+  }
+  return true;
+}
+
+
+static Dispatch_entry& dispatch_cache_entry(Obj callee, Obj types) {
+  Uns h = Uns(callee.id_hash());
+  for_val(type, types.cmpd_it()) {
+    h = h * 31 + Uns(type.id_hash());
+  }
+  return dispatch_cache[h % len_dispatch_cache];
+}
+
+
+static Dispatch_entry& dispatch_cache_entry_for_vals(Obj callee, Array vals) {
+  // equivalent to dispatch_cache_entry for the types of the args, without collecting them.
+  Uns h = Uns(callee.id_hash());
+  for_imns(i, 2, vals.len(), 2) {
+    h = h * 31 + Uns(vals.el(i).type().id_hash());
+  }
+  return dispatch_cache[h % len_dispatch_cache];
+}
+
+
+static Obj dispatch_types(Array vals) {
+  Int len_types = (vals.len() - 1) / 2;
+  Obj types = Obj::Cmpd_raw(t_Arr_Type.ret(), len_types);
+  for_in(i, len_types) {
+    types.cmpd_put(i, vals.el(i * 2 + 2).type().ret());
+  }
+  return types;
+}
+
+
+static Obj dispatch_fetch(Dispatch_site* site, Obj callee, Array vals) {
+  // returns the cached function, borrowed, or obj0.
+  if (site && site->len < dispatch_site_megamorphic) {
+    for_in(i, site->len) {
+      if (dispatch_entry_matches(site->entries[i], callee, vals)) return site->entries[i].func;
+    }
+    return obj0;
+  }
+  Dispatch_entry& e = dispatch_cache_entry_for_vals(callee, vals);
+  return dispatch_entry_matches(e, callee, vals) ? e.func : obj0;
+}
+
+
+static void dispatch_insert(Dispatch_site* site, Obj callee, Obj types, Obj func) {
+  // borrows callee, func; owns types.
+  if (site && site->len < dispatch_site_megamorphic) {
+    Int i = 0; // the first free or stale entry.
+    while (i < site->len && site->entries[i].epoch == dispatch_epoch) i++;
+    if (i < dispatch_site_len_entries) {
+      if (i == site->len) site->len++;
+      dispatch_entry_set(site->entries[i], callee, types, func);
+      return;
+    }
+    // the site becomes megamorphic; move its entries to the global cache.
+    for_in(j, dispatch_site_len_entries) {
+      Dispatch_entry& e = site->entries[j];
+      Dispatch_entry& g = dispatch_cache_entry(e.callee, e.types);
+      dispatch_entry_clear(g);
+      g = e;
+      e = {obj0, obj0, obj0, 0};
+    }
+    site->len = dispatch_site_megamorphic;
+  }
+  dispatch_entry_set(dispatch_cache_entry(callee, types), callee, types, func);
+}
+
+
+static Step run_call_dispatcher(Int d, Trace* t, Obj env, Obj call, Array vals) {
+  // owns env, the elements of vals.
+  Obj callee = vals.el(0);
+  Dispatch_site* site = dispatch_site(call);
+  Obj func = dispatch_fetch(site, callee, vals);
+  if (func.vld()) {
+    func.ret();
+  } else { // miss; run the dispatcher.
+    Obj type = callee.type();
+    Obj cell = dispatchers.fetch(type);
+    exc_check(cell.vld(), "call: %o\nobject type has no dispatcher: %o", call, type_name(type));
+    Obj types = dispatch_types(vals);
+    Array disp_vals(5);
+    disp_vals.put(0, cell.cmpd_el(0).ret());
+    disp_vals.put(1, s_callee);
+    disp_vals.put(2, callee.ret());
+    disp_vals.put(3, s_types);
+    disp_vals.put(4, types.ret());
+    Bool is_env_abandoned = t->is_env_abandoned;
+    t->is_env_abandoned = false; // env survives the dispatcher call.
+    Step step = run_Call_disp(d, t, env, call, disp_vals);
+    t->is_env_abandoned = is_env_abandoned;
+    disp_vals.dealloc();
+    step = run_tail(d, t, step);
+    env = step.res.env;
+    func = step.res.val;
+    dispatch_insert(site, callee, types, func);
+  }
+  // replace the original callee with the function returned by the dispatcher.
+  vals.el_move(0).rel();
+  vals.put(0, func);
+  return run_Call_disp(d, t, env, call, vals);
+}
+
+
+static Obj host_dispatcher_put(Trace* t, Obj env) {
+  // register b as the dispatcher for calls to instances of struct type a.
+  GET_AB;
+  exc_check(a.is_type() && is_kind_struct(type_kind(a)),
+    "dispatcher-put requires arg 1 to be a struct Type; received: %o", a);
+  Obj cell = dispatchers.fetch(a);
+  if (cell.vld()) {
+    cell.cmpd_el_move(0).rel();
+    cell.cmpd_put(0, b.ret());
+  } else {
+    dispatchers.insert(a.ret(), Obj::Cmpd(t_Arr_Obj.ret(), b.ret()));
+  }
+  dispatch_epoch++;
+  return a.ret();
+}
+
+
+static Obj host_memo_func(Trace* t, Obj env) {
+  // return a copy of fn a that caches its results; b, c, d are the capacity, evict and key options.
+  GET_ABCD;
+  exc_check(a.type() == t_Func, "memo-func requires arg 1 to be a Func; received: %o", a);
+  Func_dec* fd = func_dec(t, a);
+  exc_check(fd->is_native && fd->is_fn, "memo-func requires arg 1 to be a native fn: %o", a);
+  exc_check(!fd->memo.vld(), "memo-func: fn is already memoized: %o", a);
+  Obj memo = Obj::Cmpd(t_Memo.ret(), b.ret(), c.ret(), d.ret(), a.cmpd_el(7).ret());
+  *memo_cache_slot(memo) = memo_cache_new(t, memo); // validate the options now.
+  Obj f = Obj::Cmpd(t_Func.ret(),
+    a.cmpd_el(0).ret_val(),
+    a.cmpd_el(1).ret_val(),
+    a.cmpd_el(2).ret(),
+    a.cmpd_el(3).ret(),
+    a.cmpd_el(4).ret(),
+    a.cmpd_el(5).ret(),
+    a.cmpd_el(6).ret(),
+    memo);
+  return f;
+}
+
+
+static Obj host_memo_stats(Trace* t, Obj env) {
+  // return the hits, misses, evictions, drops, and current len of the cache of memoized fn a.
+  GET_A;
+  Func_dec* fd = (a.type() == t_Func) ? func_dec(t, a) : null;
+  exc_check(fd && fd->memo.vld(), "memo-stats requires arg 1 to be a memoized fn; received: %o",
+    a);
+  Memo_cache* mc = *memo_cache_slot(fd->memo);
+  if (!mc) return Obj::Cmpd(t_Arr_Int.ret(), int0, int0, int0, int0, int0);
+  return Obj::Cmpd(t_Arr_Int.ret(),
+    Obj::with_Int(mc->hits),
+    Obj::with_Int(mc->misses),
+    Obj::with_Int(mc->evictions),
+    Obj::with_Int(mc->drops),
+    Obj::with_Int(mc->len));
+}
+
+
+#if OPTION_ALLOC_COUNT
+static void dispatch_cleanup() {
+  for_in(i, len_dispatch_cache) {
+    dispatch_entry_clear(dispatch_cache[i]);
+  }
+  dispatchers.rel_els_dealloc();
+}
+#endif
+
+
+// the callee and the first four name/value pairs.
+static const Int len_call_buf = 9;
+
+class Call_vals {
+  // a call's interleaved name, value pairs, assembled in a fixed buffer on the stack.
+  // the buffer spills to the heap only when there are more arguments than fit,
+  // which in practice requires a splice.
+  Obj _buf[len_call_buf];
+  Obj* _els;
+  Int _len;
+  Int _cap;
+
+  void spill(Int cap) {
+    assert(cap > _cap);
+    if (_els == _buf) {
+      _els = static_cast<Obj*>(raw_alloc(cap * size_Obj, ci_Array));
+      memcpy(_els, _buf, Uns(_len * size_Obj));
+    } else {
+      _els = static_cast<Obj*>(raw_realloc(_els, cap * size_Obj, ci_Array));
+    }
+    _cap = cap;
+  }
+
+public:
+
+  explicit Call_vals(Int cap): _els(_buf), _len(0), _cap(len_call_buf) {
+    if (cap > _cap) spill(cap);
+  }
+
+  void append(Obj o) {
+    if (_len == _cap) spill(_cap * 2);
+    _els[_len++] = o;
+  }
+
+  Array array() { return Array(_len, _els); }
+
+  void dealloc() {
+    // the elements must have been moved out by the callee.
+    array().assert_cleared();
+    if (_els != _buf) raw_dealloc(_els, ci_Array);
+  }
+};
+
+
+static Bool run_call_splice_forwards(Trace* t, Array vals, Obj val) {
+  // borrows val, the value of a splice that is the last arg of a call.
+  // true if the callee is a native fn whose last par is a variad of exactly the type of val,
+  // and the preceding args are unlabeled and fill the other pars, so that val can be bound as is.
+  // val must be unique, e.g. a fresh pack; otherwise the callee's variad would alias it.
+  if (!val.is_unique()) return false;
+  Obj callee = vals.el(0);
+  if (callee.type() != t_Func) return false;
+  Func_dec* fd = func_dec(t, callee);
+  if (!fd->is_native || !fd->is_fn || fd->i_assoc >= 0 || fd->i_variad != fd->len_pars - 1
+    || vals.len() != fd->i_variad * 2 + 1) return false;
+  for_imns(i, 1, vals.len(), 2) {
+    if (vals.el(i).vld()) return false;
+  }
+  return val.type() == func_dec_pars(fd)[fd->i_variad].type;
+}
+
+
+static Step run_Call(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len();
+  exc_check(len > 0, "call is empty: %o", code);
+  // assemble vals as an array of interleaved name, value pairs.
+  // the callee never has a name, so there are an odd number of elements.
+  // the names are required for dispatch and argument binding.
+  // the names are not ref-counted, but the values are.
+  // the array can grow arbitrarily large due to splice arguments;
+  // reserve an initial capacity sufficient for the non-splice case.
+  // the callee takes ownership of the elements, but not of the storage.
+  Call_vals vals(len * 2 - 1);
+  Step step = run(d, t, env, exprs.cmpd_el(0)); // callee.
+  env = step.res.env;
+  vals.append(step.res.val);
+  for_imn(i, 1, len) {
+    Obj expr = exprs.cmpd_el(i);
+    Obj expr_t = expr.type();
+    if (expr_t == t_Splice) {
+      Obj sub_expr = expr.cmpd_el(0);
+      step = run(d, t, env, sub_expr);
+      env = step.res.env;
+      Obj val = step.res.val;
+      exc_check(val.is_cmpd(), "call: %o\nspliced value is not of a compound type: %o", val);
+      if (i == len - 1 && run_call_splice_forwards(t, vals.array(), val)) {
+        vals.append(s_SPLICED_ARR); // names are not ref-counted.
+        vals.append(val);
+        break;
+      }
+      for_val(e, val.cmpd_it()) {
+        vals.append(obj0); // no name.
+        vals.append(e.ret());
+      }
+      val.rel();
+    } else if (expr_t == t_Label) {
+      UNPACK_LABEL(expr);
+      exc_check(expr_el_type == s_nil, "call: %o\nlabeled argument cannot specify a type: %o",
+        code, expr_el_type);
+      step = run(d, t, env, expr_el_expr);
+      env = step.res.env;
+      vals.append(expr_el_name);
+      vals.append(step.res.val);
+    }
+    else { // unlabeled arg expr.
+      step = run(d, t, env, expr);
+      env = step.res.env;
+      vals.append(obj0); // no name.
+      vals.append(step.res.val);
+    }
+  }
+  step = run_Call_disp(d, t, env, code, vals.array());
+  vals.dealloc();
+  return step;
+}
+
+
+static Step run_Call_disp(Int d, Trace* t, Obj env, Obj code, Array vals) {
+  Obj callee = vals.el(0);
+  Obj type = callee.type();
+  switch (type_index(type)) {
+    case ti_Func:     return run_call_Func(d, t, env, code, vals, true);
+    case ti_Accessor: return run_call_Accessor(d, t, env, code, vals);
+    case ti_Mutator:  return run_call_Mutator(d, t, env, code, vals);
+    case ti_Sym:
+      switch (callee.sym_index()) {
+        case si_EXPAND: return run_call_EXPAND(d, t, env, code, vals);
+        case si_RUN:    return run_call_RUN(d, t, env, code, vals);
+        case si_CONS:   return run_call_CONS(d, t, env, code, vals);
+      }
+      break;
+    default: break;
+  }
+  Obj kind = type_kind(type);
+  if (is_kind_struct(kind)) {
+    return run_call_dispatcher(d, t, env, code, vals);
+  }
+  exc_raise("call: %o\nobject is not callable: %o", code, callee);
+}
+
+
+static Obj run_int_op_res(Int i) {
+  // returns obj0 if i does not fit in a tagged Int.
+  if (i < -max_Int_tagged || i > max_Int_tagged) return obj0;
+  return Obj::with_Int(i);
+}
+
+
+static Obj run_int_op_val(Int_op_index op, Obj a, Obj b) {
+  // a and b are tagged Ints; returns the result, or obj0 if the generic call must run.
+  // add and sub operate on the tagged words; the comparisons preserve order on them.
+  static const Int min_tagged = Int(Uns(-max_Int_tagged) * scale_factor_Int) | ot_int;
+  Int r;
+  switch (op) {
+    case ioi_add:
+      if (__builtin_add_overflow(a.i, b.i - ot_int, &r) || r < min_tagged) return obj0;
+      return Obj(r).ret_val();
+    case ioi_sub:
+      if (__builtin_sub_overflow(a.i, b.i - ot_int, &r) || r < min_tagged) return obj0;
+      return Obj(r).ret_val();
+    case ioi_mul:
+      if (__builtin_mul_overflow(a.int_val(), b.int_val(), &r)) return obj0;
+      return run_int_op_res(r);
+    case ioi_div: return b.int_val() ? run_int_op_res(idiv(a.int_val(), b.int_val())) : obj0;
+    case ioi_mod: return b.int_val() ? run_int_op_res(imod(a.int_val(), b.int_val())) : obj0;
+    case ioi_eq: return Obj::with_Bool(a.i == b.i);
+    case ioi_ne: return Obj::with_Bool(a.i != b.i);
+    case ioi_lt: return Obj::with_Bool(a.i < b.i);
+    case ioi_gt: return Obj::with_Bool(a.i > b.i);
+    case ioi_le: return Obj::with_Bool(a.i <= b.i);
+    case ioi_ge: return Obj::with_Bool(a.i >= b.i);
+    case ioi_none: break;
+  }
+  return obj0;
+}
+
+
+static Step run_Int_op(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  exc_check(code.cmpd_len() == 2, "Int-op requires 2 fields; received %i", code.cmpd_len());
+  Obj call = code.cmpd_el(1);
+  Obj exprs = call.cmpd_el(0);
+  Step step = run(d, t, env, exprs.cmpd_el(1));
+  env = step.res.env;
+  Obj a = step.res.val;
+  step = run(d, t, env, exprs.cmpd_el(2));
+  env = step.res.env;
+  Obj b = step.res.val;
+  Int op = code.cmpd_el(0).int_val();
+  Bool is_ints;
+  if (op & ioi_flag_ints) { // specialized by compile.
+    assert(a.is_int() && b.is_int());
+    is_ints = true;
+  } else {
+    is_ints = a.is_int() && b.is_int();
+  }
+  if (is_ints) {
+    Obj r = run_int_op_val(Int_op_index(op & ~ioi_flag_ints), a, b);
+    if (r.vld()) {
+      a.rel_val(); // Ints; this only updates the alloc counters.
+      b.rel_val();
+      return Step(env, r);
+    }
+  }
+  // fall back to the generic call; the host function raises any error.
+  step = run_sym(t, env, exprs.cmpd_el(0));
+  env = step.res.env;
+  Obj els[] = {step.res.val, obj0, a, obj0, b};
+  return run_call_Func(d, t, env, call, Array(5, els), true);
+}
+
+
+static Step run_Cons_struct(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  // compile_cons_struct has checked the field count and labels, so the args are run in place.
+  exc_check(code.cmpd_len() == 2, "Cons-struct requires 2 fields; received %i", code.cmpd_len());
+  Obj type = code.cmpd_el(0);
+  Obj exprs = code.cmpd_el(1).cmpd_el(0);
+  Int len = exprs.cmpd_len() - 2;
+  Obj res = Obj::Cmpd_raw(type.ret(), len);
+  for_in(i, len) {
+    Obj expr = exprs.cmpd_el(i + 2);
+    if (expr.type() == t_Label) expr = expr.cmpd_el(2);
+    Step step = run(d, t, env, expr);
+    env = step.res.env;
+    res.cmpd_put(i, step.res.val);
+  }
+  return Step(env, res);
+}
+
+
+static Bool run_inlined_is_current(Obj code) {
+  // true if the Func of Inlined node code still has the fields that compile inlined.
+  Obj func = code.cmpd_el(1);
+  Obj fields = code.cmpd_el(2);
+  for_in(i, fields.cmpd_len()) {
+    if (func.cmpd_el(i) != fields.cmpd_el(i)) return false;
+  }
+  return true;
+}
+
+
+static Step run_Inlined(UNUSED Int d, UNUSED Trace* t, Obj env, Obj code) {
+  // owns env.
+  // the body runs as a tail step in env, as the body of the call would run in its frame,
+  // so that a trace through the node shows both the call site and the body.
+  // the hidden word holds the value of func_mutation_count when the Func was last found unchanged;
+  // once it has changed, the node makes the original call instead.
+  exc_check(code.cmpd_len() == 4, "Inlined requires 4 fields; received %i", code.cmpd_len());
+  Int* checked_count = reinterpret_cast<Int*>(code.cmpd_els_unchecked() + code.cmpd_len());
+  if (UNLIKELY(*checked_count != func_mutation_count)) {
+    if (!run_inlined_is_current(code)) return Step(env, env, code.cmpd_el(0));
+    *checked_count = func_mutation_count;
+  }
+  return Step(env, env, code.cmpd_el(3));
+}
+
+
+// printed before each run step; white_down_pointing_small_triangle.
+static const Chars trace_run_prefix = "▿ ";
+
+// printed before each run tail step; white_right_pointing_small_triangle.
+static const Chars trace_tail_prefix  = "▹ ";
+
+// printed after each run step; white_bullet.
+static const Chars trace_val_prefix = "◦ ";
+
+// printed before each macro expand step; white_diamond.
+static const Chars trace_expand_prefix = "◇ ";
+
+// printed after each macro expand step; white_small_square.
+static const Chars trace_expand_val_prefix = "▫ ";
+
+
+
+static Step run_step_disp(Int d, Trace* t, Obj env, Obj code) {
+  // owns env.
+  Obj_tag ot = code.tag();
+  if (ot == ot_ptr) {
+    exc_raise("cannot run Ptr object: %o", code);
+  }
+  if (ot == ot_int) {
+    return Step(env, code.ret_val()); // self-evaluating.
+  }
+  if (ot == ot_sym) {
+    if (code.is_data_word()) {
+      return Step(env, code.ret_val()); // self-evaluating.
+    } else {
+      return run_sym(t, env, code);
+    }
+  }
+  assert(ot == ot_ref);
+  // switch on the type index, which compiles to a jump table.
+  switch (type_index(code.ref_type())) {
+    case ti_Data:
+    case ti_Accessor:
+    case ti_Mutator:
+      return Step(env, code.ret()); // self-evaluating.
+#define DISP(form) case ti_##form: return run_##form(d, t, env, code)
+    DISP(Quo);
+    DISP(Arr_Expr);
+    DISP(Let);
+    DISP(Pub);
+    DISP(If);
+    DISP(Loop);
+    DISP(Each);
+    DISP(Case);
+    DISP(Values);
+    DISP(Let_vals);
+    DISP(Fn);
+    DISP(Call);
+    DISP(Int_op);
+    DISP(Cons_struct);
+    DISP(Inlined);
+#undef DISP
+    default: break;
+  }
+  exc_raise("cannot run object: %o", code);
+}
+
+
+static Bool trace_eval = false;
+
+COLD static void run_err_trace_write(Int d, Chars p, Obj o) {
+  for_in(i, d) err(i % 4 ? " " : "|");
+  errFL("%s %o", p, o);
+}
+
+
+static inline void run_err_trace(Int d, Chars p, Obj o) {
+  // verbose eval tracing is rare; keep the check inline and the writing out of line.
+  if (UNLIKELY(trace_eval)) run_err_trace_write(d, p, o);
+}
+
+
+template <Bool is_traced>
+static Step run_tail_steps(Int d, Trace* parent_trace, Step step) {
+  // in res case, owns res.env, res.val;
+  // in tail case, owns tail.env, tail.callee_env; borrows tail.code.
+  // note: if tail.env is tail.callee_env, it is only retained once.
+  // instantiated separately for verbose eval tracing, so that the steps do not test trace_eval.
+  if (is_step_res(step)) {
+    if (is_traced) run_err_trace_write(d, trace_val_prefix, step.res.val);
+    return step;
+  }
+  Obj base_env = step.tail.env; // hold onto the 'next' env for the topmost caller.
+  Trace t(&step.tail.code, -1, parent_trace); // step is only reassigned once each step returns.
+  // t.is_env_abandoned is false until any tail code creates a new scope;
+  // until then, base_env is updated. once any scope is introduced,
+  // the env of each step is abandoned when the step completes.
+  do { // TCO step.
+    if (is_traced) run_err_trace_write(d, trace_tail_prefix, step.tail.code);
+    // if the tail step is a scope or call, then a new callee environment is introduced.
+    // otherwise, env and callee_env are identical, and that env was only retained once.
+    Bool is_local_step = (step.tail.env == step.tail.callee_env);
+    if (!is_local_step) { // step is a new scope step (scope or macro/function body).
+      if (!t.is_env_abandoned) { // ownership transferred to base_env.
+        assert(base_env == step.tail.env);
+      } else { // env is abandoned due to tail call or tail scope.
+        step.tail.env.rel();
+      }
+    }
+    t.elided_step_count++;
+    step = run_step_disp(d, &t, step.tail.callee_env, step.tail.code); // consumes callee_env.
+    if (!t.is_env_abandoned) {
+      if (is_local_step) { // base_env/env/callee_env was just consumed and is now dead.
+        base_env = step.res.env; // accessing new env is valid for either res or step morphs.
+      } else { // once a scope is introduced we no longer update base_env.
+        t.is_env_abandoned = true;
+      }
+    }
+    // otherwise, for a local tail step inside of a call, callee_env was consumed,
+    // base_env does not change and rc is already correct; for a new scope step,
+    // res.env is the new callee env.
+  } while (!is_step_res(step));
+  if (step.res.env != base_env) {
+    step.res.env.rel(); 
+    step.res.env = base_env; // replace whatever modified callee env from TCO with the topmost env.
+  }
+  if (is_traced) run_err_trace_write(d, trace_val_prefix, step.res.val);
+  return step;
+}
+
+
+static Step run_tail(Int d, Trace* parent_trace, Step step) {
+  // run the tail steps of step; for callers other than run, which tests trace_eval itself.
+  if (UNLIKELY(trace_eval)) return run_tail_steps<true>(d, parent_trace, step);
+  return run_tail_steps<false>(d, parent_trace, step);
+}
+
+
+// the evaluator recurses on the native stack.
+// to allow deep non-tail recursion, run moves onto a new, heap-allocated stack segment
+// whenever the space remaining in the current one falls below stack_seg_reserve.
+// the segments form a chain; a returning segment keeps one spare successor for reuse,
+// so that recursion oscillating around a segment boundary does not allocate.
+// the total size of all segments is limited by OPTION_STACK_LIMIT.
+
+struct Stack_seg {
+  Stack_seg* prev;
+  Stack_seg* next; // spare successor, or null.
+  Char* low; // run moves to a new segment when the stack pointer falls below this address.
+  ucontext_t ctx; // the context running on this segment.
+  ucontext_t ret_ctx; // the context in the previous segment to return to.
+  // the run call to perform on this segment; env is replaced by the resulting env.
+  Int depth;
+  Trace* trace;
+  Obj env;
+  Obj code;
+  Obj val; // the resulting val.
+  Int len_extra; // the number of extra values in run_vals.
+};
+
+static const Int stack_seg_size = 1<<20; // including the Stack_seg header.
+static const Int stack_seg_reserve = 1<<17; // headroom for host functions and steps between runs.
+
+static Stack_seg stack_seg_main;
+static Stack_seg* stack_seg_cur = &stack_seg_main;
+static Int stack_seg_total;
+
+
+static void stack_seg_init(Int main_stack_size) {
+  // called by main, near the top of the main stack.
+  Char* base = static_cast<Char*>(__builtin_frame_address(0));
+  Int slack = 1<<16; // the environment, arguments, and frames above main.
+  stack_seg_main.low = base - main_stack_size + slack + stack_seg_reserve;
+}
+
+
+static void stack_seg_entry() {
+  Stack_seg* seg = stack_seg_cur;
+  Step step = run(seg->depth, seg->trace, seg->env, seg->code);
+  seg->env = step.res.env;
+  seg->val = step.res.val;
+  seg->len_extra = step.res.len_extra;
+  swapcontext(&seg->ctx, &seg->ret_ctx); // never resumed.
+}
+
+
+NO_INLINE static Stack_seg* stack_seg_next(Trace* t, Stack_seg* prev) {
+  // returns the spare successor of prev, or a new one.
+  // kept out of line, so that the assignments to seg do not precede getcontext in the caller.
+  Stack_seg* seg = prev->next;
+  if (seg) return seg;
+  exc_check(stack_seg_total + stack_seg_size <= OPTION_STACK_LIMIT,
+    "execution exceeded stack limit: %i bytes", Int(OPTION_STACK_LIMIT));
+  seg = static_cast<Stack_seg*>(raw_alloc(stack_seg_size, ci_Stack_seg));
+  stack_seg_total += stack_seg_size;
+  seg->prev = prev;
+  seg->next = null;
+  seg->low = reinterpret_cast<Char*>(seg + 1) + stack_seg_reserve;
+  prev->next = seg;
+  return seg;
+}
+
+
+static Step run_on_new_seg(Int depth, Trace* t, Obj env, Obj code) {
+  // owns env.
+  // getcontext returns twice; the locals are assigned once before it, so are not clobbered.
+  Stack_seg* const prev = stack_seg_cur;
+  Stack_seg* const seg = stack_seg_next(t, prev);
+  seg->depth = depth;
+  seg->trace = t;
+  seg->env = env;
+  seg->code = code;
+  getcontext(&seg->ctx);
+  seg->ctx.uc_stack.ss_sp = seg + 1;
+  seg->ctx.uc_stack.ss_size = Uns(stack_seg_size - Int(sizeof(Stack_seg)));
+  seg->ctx.uc_link = null;
+  makecontext(&seg->ctx, stack_seg_entry, 0);
+  stack_seg_cur = seg;
+  swapcontext(&seg->ret_ctx, &seg->ctx);
+  stack_seg_cur = prev;
+  if (seg->next) { // keep at most one spare segment.
+    assert(!seg->next->next);
+    raw_dealloc(seg->next, ci_Stack_seg);
+    stack_seg_total -= stack_seg_size;
+    seg->next = null;
+  }
+  Step step(seg->env, seg->val);
+  step.res.len_extra = seg->len_extra;
+  return step;
+}
+
+
+#if OPTION_ALLOC_COUNT
+static void stack_seg_cleanup() {
+  assert(stack_seg_cur == &stack_seg_main);
+  Stack_seg* seg = stack_seg_main.next;
+  if (seg) {
+    assert(!seg->next);
+    raw_dealloc(seg, ci_Stack_seg);
+    stack_seg_main.next = null;
+  }
+}
+#endif
+
+
+static Step run(Int depth, Trace* parent_trace, Obj env, Obj code) {
+  // owns env.
+  if (static_cast<Char*>(__builtin_frame_address(0)) < stack_seg_cur->low) {
+    return run_on_new_seg(depth, parent_trace, env, code);
+  }
+  Int d = depth + 1;
+  Trace t(&code, 0, parent_trace);
+  if (UNLIKELY(trace_eval)) {
+    run_err_trace_write(d, trace_run_prefix, code);
+    return run_tail_steps<true>(d, &t, run_step_disp(d, &t, env, code));
+  }
+  return run_tail_steps<false>(d, &t, run_step_disp(d, &t, env, code));
+}
+
+
+static Step run_code(Obj env, Obj code) {
+  // owns env.
+  return run(-1, null, env, code);
+}
+
+
+static Obj run_macro(Trace* t, Obj env, Obj code) {
+  // owns env.
+  run_err_trace(0, trace_expand_prefix, code);
+  assert(code.cmpd_len() == 1);
+  Obj exprs = code.cmpd_el(0);
+  Int len = exprs.cmpd_len(); 
+  exc_check(len > 0, "expand: %o\nempty", code);
+  Obj macro_sym = exprs.cmpd_el(0);
+  exc_check(macro_sym.is_sym(), "expand: %o\nargument 0 must be a Sym; found: %o",
+    code, macro_sym);
+  Obj macro = env_get(env, macro_sym);
+  exc_check(macro.vld(), "expand: %o\nmacro lookup error: %o", code, macro_sym);
+  exc_check(macro.type() == t_Func, "expand; %o\nmacro is not a Func: %o", code, macro);
+  Array vals(len * 2 - 1);
+  vals.put(0, macro.ret());
+  for_imn(i, 1, len) {
+    // note: labels and splices are passed directly through as arguments;
+    // otherwise we would need some sort of label 'escape' syntax.
+    Obj expr = exprs.cmpd_el(i);
+    vals.put(i * 2 - 1, obj0);
+    vals.put(i * 2, expr.ret());
+  }
+  Step step = run_call_Func(0, t, env, code, vals, false); // owns env, macro.
+  vals.dealloc();
+  step = run_tail(0, t, step); // handle any TCO steps.
+  step.res.env.rel();
+  run_err_trace(0, trace_expand_val_prefix, step.res.val);
+  return step.res.val;
+}
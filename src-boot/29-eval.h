@@ -1,7 +1,7 @@
 // Copyright 2014 George King.
 // Permission to use this file is granted in ploy/license.txt.
 
-#include "25-run.h"
+#include "28-run.h"
 
 
 static Step eval(Obj env, Obj code) {
@@ -1,7 +1,7 @@
 // Copyright 2013 George King.
 // Permission to use this file is granted in ploy/license.txt.
 
-#include "26-eval.h"
+#include "29-eval.h"
 
 
 static Obj parse_and_eval(Dict& src_locs, Obj env, Obj path, Obj src, Bool should_output_val) {
@@ -23,16 +23,18 @@ static Obj parse_and_eval(Dict& src_locs, Obj env, Obj path, Obj src, Bool shoul
 }
 
 
+static const Int main_stack_size = 1<<21; // 2mb.
+
 static void reduce_stack_limit() {
-  // reduce the maximum stack size to make runaway recursion fail faster.
+  // deep evaluation moves onto heap stack segments, so the main stack can be small.
   struct rlimit rl;
 #if 0
   // use this to inspect the default limits.
   Bool get_ok = !getrlimit(RLIMIT_STACK, &rl); assert(get_ok);
   errFL("rlimit: soft: %u; hard: %u", rl.rlim_cur, rl.rlim_max);
 #endif
-  rl.rlim_cur = 1<<21; // 2mb stack.
-  rl.rlim_max = 1<<21;
+  rl.rlim_cur = main_stack_size;
+  rl.rlim_max = main_stack_size;
   Bool ok = !setrlimit(RLIMIT_STACK, &rl);
   check(ok, "setrlimit failed");
 }
@@ -42,10 +44,12 @@ int main(int argc, Chars argv[]) {
   assert_host_basic();
   assert(size_Obj == size_Raw);
   reduce_stack_limit();
+  stack_seg_init(main_stack_size);
   type_init_vars();
   sym_init(); // requires type_init_table.
   env_init();
   Obj env = type_init_values(s_ENV_END.ret_val()); // requires sym_init.
+  packed_ops_init();
   env = host_init(env);
 
   // parse arguments.
@@ -93,9 +97,12 @@ int main(int argc, Chars argv[]) {
   // cleanup in reverse order.
   global_src_locs.rel_els();
   global_src_locs.dealloc();
+  dispatch_cleanup();
+  run_vals_cleanup();
   global_cleanup();
   env.rel();
   env_cleanup();
+  stack_seg_cleanup();
   // release but do not clear to facilitate debugging during type_cleanup.
   sym_names.rel_els(false);
   type_cleanup();